@@ -0,0 +1,255 @@
+// Microbenchmarks for the intersection and traversal kernels.
+// Build and run with `make bench`; `./raytracer_bench <filter>` runs only the
+// benchmarks whose name contains the filter.
+#include "scene.h"
+#include "boundingbox.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int Repetitions = 9;
+const double MinSampleSeconds = 0.02;
+
+// Results are accumulated here so the compiler cannot drop the measured work
+volatile float floatSink;
+volatile int intSink;
+
+std::string filter;
+
+double secondsFor(const std::function<void()>& batch, long repeats) {
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < repeats; ++i) {
+        batch();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Times `batch`, which performs `operations` operations, over Repetitions samples
+// of at least MinSampleSeconds each. Reports the median time per operation, the
+// median absolute deviation relative to it, and the throughput.
+void measure(const std::string& name, size_t operations, const std::function<void()>& batch) {
+    if (name.find(filter) == std::string::npos) {
+        return;
+    }
+
+    // Warm up caches and find how many batches fill a sample
+    double single = std::max(secondsFor(batch, 1), 1e-9);
+    long repeats = std::max(1L, static_cast<long>(std::ceil(MinSampleSeconds / single)));
+
+    std::vector<double> nanoseconds;
+    for (int i = 0; i < Repetitions; ++i) {
+        nanoseconds.push_back(secondsFor(batch, repeats) * 1e9 / (static_cast<double>(repeats) * operations));
+    }
+    std::sort(nanoseconds.begin(), nanoseconds.end());
+    double median = nanoseconds[Repetitions / 2];
+
+    std::vector<double> deviations;
+    for (double value : nanoseconds) {
+        deviations.push_back(std::abs(value - median));
+    }
+    std::sort(deviations.begin(), deviations.end());
+    double deviation = deviations[Repetitions / 2];
+
+    std::printf("%-36s %12.2f ns/op  +-%5.1f%%  %10.3f Mops/s\n", name.c_str(), median,
+                100.0 * deviation / median, 1e3 / median);
+    std::fflush(stdout);
+}
+
+Vector3 randomUnitVector(std::mt19937& rng) {
+    std::normal_distribution<float> normal;
+    Vector3 v;
+    do {
+        v = Vector3(normal(rng), normal(rng), normal(rng));
+    } while (v.lengthSquared() < 1e-6f);
+    return v.normalize();
+}
+
+// Rays from a sphere of the given radius towards the origin, jittered so that
+// roughly half of them miss a unit-sized target
+std::vector<Ray> raysTowardsOrigin(size_t count, float radius, float jitter, std::mt19937& rng) {
+    std::uniform_real_distribution<float> offset(-jitter, jitter);
+    std::vector<Ray> rays;
+    for (size_t i = 0; i < count; ++i) {
+        Vector3 origin = randomUnitVector(rng) * radius;
+        Vector3 target(offset(rng), offset(rng), offset(rng));
+        rays.emplace_back(origin, target - origin);
+    }
+    return rays;
+}
+
+void addRandomSpheres(Scene& scene, size_t count, MaterialId material, std::mt19937& rng) {
+    float extent = std::cbrt(static_cast<float>(count)) * 2.0f;
+    std::uniform_real_distribution<float> position(-extent, extent);
+    std::uniform_real_distribution<float> radius(0.2f, 0.8f);
+    for (size_t i = 0; i < count; ++i) {
+        scene.addSphere(Vector3(position(rng), position(rng), position(rng)), radius(rng), material);
+    }
+}
+
+void addTriangleSoup(Scene& scene, size_t count, MaterialId material, std::mt19937& rng) {
+    float extent = std::cbrt(static_cast<float>(count)) * 2.0f;
+    std::uniform_real_distribution<float> position(-extent, extent);
+    std::uniform_real_distribution<float> edge(-1.0f, 1.0f);
+    for (size_t i = 0; i < count; ++i) {
+        Vector3 v0(position(rng), position(rng), position(rng));
+        Vector3 v1 = v0 + Vector3(edge(rng), edge(rng), edge(rng));
+        Vector3 v2 = v0 + Vector3(edge(rng), edge(rng), edge(rng));
+        scene.addTriangle(v0, v1, v2, material);
+    }
+}
+
+// Connected heightfield mesh of about `count` triangles, the shape of a scanned terrain
+void addMesh(Scene& scene, size_t count, MaterialId material) {
+    int cells = std::max(1, static_cast<int>(std::sqrt(count / 2.0)));
+    float extent = std::cbrt(static_cast<float>(count)) * 2.0f;
+    auto vertex = [&](int i, int j) {
+        float x = (static_cast<float>(i) / cells - 0.5f) * 2.0f * extent;
+        float z = (static_cast<float>(j) / cells - 0.5f) * 2.0f * extent;
+        return Vector3(x, std::sin(x * 0.7f) * std::cos(z * 0.5f) * extent * 0.2f, z);
+    };
+    for (int i = 0; i < cells; ++i) {
+        for (int j = 0; j < cells; ++j) {
+            scene.addTriangle(vertex(i, j), vertex(i + 1, j), vertex(i + 1, j + 1), material);
+            scene.addTriangle(vertex(i, j), vertex(i + 1, j + 1), vertex(i, j + 1), material);
+        }
+    }
+}
+
+void primitiveBenchmarks() {
+    std::mt19937 rng(12345);
+    std::vector<Ray> rays = raysTowardsOrigin(4096, 5.0f, 1.5f, rng);
+
+    Sphere sphere(Vector3(0, 0, 0), 1.0f, 0);
+    measure("sphere/intersect", rays.size(), [&] {
+        float sum = 0.0f;
+        for (const Ray& ray : rays) sum += sphere.getIntersectionDistance(ray);
+        floatSink = sum;
+    });
+
+    Triangle triangle(Vector3(-1, -1, 0), Vector3(1, -1, 0), Vector3(0, 1, 0), 0);
+    measure("triangle/intersect", rays.size(), [&] {
+        float sum = 0.0f;
+        for (const Ray& ray : rays) sum += triangle.getIntersectionDistance(ray);
+        floatSink = sum;
+    });
+
+    Cylinder cylinder(Vector3(0, 0, 0), Vector3(0.3f, 1, 0.2f), 0.8f, 2.0f, 0);
+    measure("cylinder/intersect", rays.size(), [&] {
+        float sum = 0.0f;
+        Cylinder::Part part;
+        for (const Ray& ray : rays) sum += cylinder.intersect(ray, part);
+        floatSink = sum;
+    });
+
+    BoundingBox box(Vector3(-1, -1, -1), Vector3(1, 1, 1));
+    measure("boundingbox/slab", rays.size(), [&] {
+        int hits = 0;
+        for (const Ray& ray : rays) hits += box.doesIntersect(ray);
+        intSink = hits;
+    });
+}
+
+void sceneBenchmarks(const std::string& kind, size_t count) {
+    std::mt19937 rng(12345);
+    Scene scene;
+    MaterialId material = scene.addMaterial(Material());
+    if (kind == "spheres") {
+        addRandomSpheres(scene, count, material, rng);
+    } else if (kind == "soup") {
+        addTriangleSoup(scene, count, material, rng);
+    } else {
+        addMesh(scene, count, material);
+    }
+
+    std::string prefix = "bvh/" + kind + "/" + std::to_string(count);
+    measure(prefix + "/build (per primitive)", count, [&] { scene.buildBVH(); });
+    scene.buildBVH();
+
+    // Camera-like rays from outside the scene bounds through its centre region
+    float extent = std::cbrt(static_cast<float>(count)) * 2.0f;
+    std::vector<Ray> rays = raysTowardsOrigin(4096, extent * 3.0f, extent, rng);
+
+    measure(prefix + "/closest hit", rays.size(), [&] {
+        int hits = 0;
+        HitRecord hit;
+        for (const Ray& ray : rays) hits += scene.intersect(ray, std::numeric_limits<float>::max(), hit);
+        intSink = hits;
+    });
+
+    measure(prefix + "/any hit", rays.size(), [&] {
+        int hits = 0;
+        for (const Ray& ray : rays) hits += scene.traceRay(ray);
+        intSink = hits;
+    });
+}
+
+// Lookups in every storage format, with each format's footprint and its error against
+// the float texture over the lookup positions
+void textureBenchmarks(const std::string& filename) {
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> coordinate(0.0f, 1.0f);
+    std::vector<std::pair<float, float>> positions;
+    for (int i = 0; i < 4096; ++i) {
+        positions.emplace_back(coordinate(rng), coordinate(rng));
+    }
+
+    Texture reference(filename);
+    if (!reference.isLoaded()) {
+        return;
+    }
+
+    for (TextureFormat format : {TextureFormat::Float, TextureFormat::FP16, TextureFormat::RGBA8, TextureFormat::RGB8,
+                                 TextureFormat::BC1}) {
+        std::string name = std::string("texture/") + textureFormatName(format);
+        if (name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        Texture texture(filename, format);
+        double squaredError = 0.0;
+        for (const auto& [u, v] : positions) {
+            Color a = texture.getColorAt(u, v), b = reference.getColorAt(u, v);
+            squaredError += (a.r - b.r) * (a.r - b.r) + (a.g - b.g) * (a.g - b.g) + (a.b - b.b) * (a.b - b.b);
+        }
+        std::printf("%-36s %12.2f MB        rmse %.5f\n", (name + "/footprint").c_str(),
+                    texture.getMemoryBytes() / (1024.0 * 1024.0), std::sqrt(squaredError / (3.0 * positions.size())));
+
+        measure(name + "/bilinear", positions.size(), [&] {
+            float sum = 0.0f;
+            for (const auto& [u, v] : positions) sum += texture.getColorAt(u, v).g;
+            floatSink = sum;
+        });
+        measure(name + "/trilinear", positions.size(), [&] {
+            float sum = 0.0f;
+            for (const auto& [u, v] : positions) sum += texture.getColorAt(u, v, 0.004f, 0.0f, 0.0f, 0.004f).g;
+            floatSink = sum;
+        });
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        filter = argv[1];
+    }
+
+    std::printf("%d samples of >= %.0f ms each; median and median absolute deviation\n\n",
+                Repetitions, MinSampleSeconds * 1e3);
+
+    primitiveBenchmarks();
+    textureBenchmarks("textures/red.ppm");
+    for (const char* kind : {"spheres", "soup", "mesh"}) {
+        for (size_t count : {1000, 10000, 100000}) {
+            sceneBenchmarks(kind, count);
+        }
+    }
+    return 0;
+}
@@ -15,10 +15,7 @@ public:
     
     // Merge two bounding boxes
     static BoundingBox merge(const BoundingBox& a, const BoundingBox& b) {
-        return BoundingBox(
-            Vector3(std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z)),
-            Vector3(std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z))
-        );
+        return BoundingBox(Vector3::min(a.min, b.min), Vector3::max(a.max, b.max));
     }
 
     // Check if a ray intersects the bounding box
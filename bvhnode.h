@@ -6,6 +6,7 @@
 #include "sphere.h"
 #include "triangle.h"
 #include "cylinder.h"
+#include "stats.h"
 #include <vector>
 #include <memory>
 #include <algorithm>
@@ -28,6 +29,7 @@ public:
         }
 
         bool doesIntersect(const Ray& ray) const {
+            if (object == ray.excluded) return false;
             switch (type) {
                 case PrimitiveType::Sphere:
                     return static_cast<Sphere*>(object)->doesIntersect(ray);
@@ -41,17 +43,88 @@ public:
         }
 
         float getIntersectionDistance(const Ray& ray) const {
+            int part;
+            return getIntersectionDistance(ray, part);
+        }
+
+        // Closest hit distance; `part` records which surface of the primitive was hit
+        float getIntersectionDistance(const Ray& ray, int& part) const {
+            part = 0;
+            if (object == ray.excluded) return -1.0f;
             switch (type) {
                 case PrimitiveType::Sphere:
                     return static_cast<Sphere*>(object)->getIntersectionDistance(ray);
                 case PrimitiveType::Triangle:
                     return static_cast<Triangle*>(object)->getIntersectionDistance(ray);
-                case PrimitiveType::Cylinder:
-                    return static_cast<Cylinder*>(object)->getIntersectionDistance(ray);
+                case PrimitiveType::Cylinder: {
+                    Cylinder::Part cylinderPart;
+                    float distance = static_cast<Cylinder*>(object)->intersect(ray, cylinderPart);
+                    part = cylinderPart;
+                    return distance;
+                }
                 default:
                     return -1.0f;
             }
         }
+
+        // Hit point `distance` along the ray. Curved surfaces snap it back onto the
+        // surface, so its error depends on its magnitude rather than on the root solve.
+        Vector3 getSurfacePoint(const Ray& ray, float distance, int part) const {
+            Vector3 point = Vector3::madd(ray.direction, distance, ray.origin);
+            switch (type) {
+                case PrimitiveType::Sphere:
+                    return static_cast<Sphere*>(object)->projectToSurface(point);
+                case PrimitiveType::Cylinder:
+                    return static_cast<Cylinder*>(object)->projectToSurface(point, static_cast<Cylinder::Part>(part));
+                default:
+                    return point;
+            }
+        }
+
+        // Flat primitives cannot be hit again by a ray leaving them
+        bool isFlat() const {
+            return type == PrimitiveType::Triangle;
+        }
+
+        Vector3 getNormal(const Vector3& point, int part) const {
+            switch (type) {
+                case PrimitiveType::Sphere:
+                    return static_cast<Sphere*>(object)->getNormal(point);
+                case PrimitiveType::Triangle:
+                    return static_cast<Triangle*>(object)->getNormal(point);
+                case PrimitiveType::Cylinder:
+                    return static_cast<Cylinder*>(object)->getNormal(point, static_cast<Cylinder::Part>(part));
+                default:
+                    return Vector3();
+            }
+        }
+
+        void getTextureCoordinates(const Vector3& point, int part, float& u, float& v) const {
+            switch (type) {
+                case PrimitiveType::Sphere:
+                    static_cast<Sphere*>(object)->getTextureCoordinates(point, u, v);
+                    break;
+                case PrimitiveType::Triangle:
+                    static_cast<Triangle*>(object)->getTextureCoordinates(point, u, v);
+                    break;
+                case PrimitiveType::Cylinder:
+                    static_cast<Cylinder*>(object)->getTextureCoordinates(point, static_cast<Cylinder::Part>(part), u, v);
+                    break;
+            }
+        }
+
+        MaterialId getMaterialId() const {
+            switch (type) {
+                case PrimitiveType::Sphere:
+                    return static_cast<Sphere*>(object)->getMaterialId();
+                case PrimitiveType::Triangle:
+                    return static_cast<Triangle*>(object)->getMaterialId();
+                case PrimitiveType::Cylinder:
+                    return static_cast<Cylinder*>(object)->getMaterialId();
+                default:
+                    return 0;
+            }
+        }
     };
 
     BoundingBox bbox;
@@ -71,7 +144,11 @@ public:
             auto node = std::make_unique<BVHNode>();
             node->primitives = std::move(primitives);
 
-            // Compute bounding box for all primitives
+            // Compute bounding box for all primitives; start from the first box, as a
+            // default box is a point at the origin and would always be included
+            if (!node->primitives.empty()) {
+                node->bbox = node->primitives[0].getBoundingBox();
+            }
             for (const auto& primitive : node->primitives) {
                 node->bbox = BoundingBox::merge(node->bbox, primitive.getBoundingBox());
             }
@@ -79,7 +156,7 @@ public:
         }
 
         // Compute the overall bounding box
-        BoundingBox globalBox;
+        BoundingBox globalBox = primitives[0].getBoundingBox();
         for (const auto& primitive : primitives) {
             globalBox = BoundingBox::merge(globalBox, primitive.getBoundingBox());
         }
@@ -113,7 +190,9 @@ public:
 
     // Check for ray intersection
     bool doesIntersect(const Ray& ray) const {
+        STATS_ADD(BVHNodeVisits, 1);
         if (!bbox.doesIntersect(ray)) return false;
+        STATS_ADD(PrimitiveTests, primitives.size());
 
         for (const auto& primitive : primitives) {
             if (primitive.doesIntersect(ray)) return true;
@@ -149,53 +228,54 @@ public:
         return closest == std::numeric_limits<float>::max() ? -1.0f : closest;
     }
 
-    bool trace(const Ray& ray, float& closestDistance, Vector3& hitPoint, Vector3& normal, Color& objectColor, float& reflectivity, float& transparency, float& refractiveIndex) const {
+    // Call visit(primitive, distance, part) for every surface crossing on the ray before
+    // maxDistance, in traversal order and including each crossing of a primitive the ray
+    // passes through. Stops and returns false as soon as visit returns false.
+    template <typename Visitor>
+    bool visitHits(const Ray& ray, float maxDistance, Visitor& visit) const {
+        STATS_ADD(BVHNodeVisits, 1);
+        if (!bbox.doesIntersect(ray)) return true;
+        STATS_ADD(PrimitiveTests, primitives.size());
+
+        for (const auto& primitive : primitives) {
+            int part;
+            float distance = primitive.getIntersectionDistance(ray, part);
+            if (distance <= 0 || distance >= maxDistance) continue;
+
+            // Further crossings of the same primitive lie beyond this one
+            Ray remaining = ray;
+            do {
+                if (!visit(primitive, distance, part)) return false;
+                remaining.tMin = distance;
+                distance = primitive.getIntersectionDistance(remaining, part);
+            } while (distance > 0 && distance < maxDistance);
+        }
+
+        return (!left || left->visitHits(ray, maxDistance, visit)) &&
+               (!right || right->visitHits(ray, maxDistance, visit));
+    }
+
+    // Find the closest primitive hit; shading data is resolved by the caller
+    bool trace(const Ray& ray, float& closestDistance, const Primitive*& hitPrimitive, int& hitPart) const {
+        STATS_ADD(BVHNodeVisits, 1);
         if (!bbox.doesIntersect(ray)) return false;
+        STATS_ADD(PrimitiveTests, primitives.size());
 
         bool hit = false;
 
         for (const auto& primitive : primitives) {
-            float distance = primitive.getIntersectionDistance(ray);
+            int part;
+            float distance = primitive.getIntersectionDistance(ray, part);
             if (distance > 0 && distance < closestDistance) {
                 closestDistance = distance;
-                hitPoint = ray.origin + ray.direction * distance;
+                hitPrimitive = &primitive;
+                hitPart = part;
                 hit = true;
-
-                // Retrieve data for shading based on the primitive type
-                switch (primitive.type) {
-                    case Primitive::PrimitiveType::Sphere: {
-                        auto sphere = static_cast<Sphere*>(primitive.object);
-                        normal = (hitPoint - sphere->getCenter()).normalize();
-                        objectColor = sphere->getColor(hitPoint);
-                        reflectivity = sphere->getReflectivity();
-                        transparency = sphere->getTransparency();
-                        refractiveIndex = sphere->getRefractiveIndex();
-                        break;
-                    }
-                    case Primitive::PrimitiveType::Triangle: {
-                        auto triangle = static_cast<Triangle*>(primitive.object);
-                        normal = triangle->getNormal(hitPoint);
-                        objectColor = triangle->getColor(hitPoint);
-                        reflectivity = triangle->getReflectivity();
-                        transparency = triangle->getTransparency();
-                        refractiveIndex = triangle->getRefractiveIndex();
-                        break;
-                    }
-                    case Primitive::PrimitiveType::Cylinder: {
-                        auto cylinder = static_cast<Cylinder*>(primitive.object);
-                        normal = cylinder->getNormal(hitPoint);
-                        objectColor = cylinder->getColor(hitPoint);
-                        reflectivity = cylinder->getReflectivity();
-                        transparency = cylinder->getTransparency();
-                        refractiveIndex = cylinder->getRefractiveIndex();
-                        break;
-                    }
-                }
             }
         }
 
-        if (left) hit |= left->trace(ray, closestDistance, hitPoint, normal, objectColor, reflectivity, transparency, refractiveIndex);
-        if (right) hit |= right->trace(ray, closestDistance, hitPoint, normal, objectColor, reflectivity, transparency, refractiveIndex);
+        if (left) hit |= left->trace(ray, closestDistance, hitPrimitive, hitPart);
+        if (right) hit |= right->trace(ray, closestDistance, hitPrimitive, hitPart);
 
         return hit;
     }
@@ -1,83 +1,353 @@
 #include "camera.h"
 #include "scene.h"
 #include "color.h"
+#include "integrator.h"
+#include "checkpoint.h"
+#include "renderprofile.h"
+#include "stats.h"
 #include <fstream>
+#include <iostream>
 #include <cmath>
-#include <random>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
 
 Camera::Camera(Vector3 pos, Vector3 dir, Vector3 up, float fov, int w, int h, float aperture, float focusDistance)
-    : position(pos), forward(dir.normalize()), up(up.normalize()), fov(fov), width(w), height(h), aperture(aperture), focusDistance(focusDistance) {}
+    : position(pos), forward(dir.normalize()), up(up.normalize()), fov(fov), aperture(aperture), focusDistance(focusDistance), width(w), height(h) {
+    rightVector = forward.cross(this->up).normalize();
+    horizontal = rightVector * 2.0f * std::tan(fov / 2.0f) * focusDistance;
+    vertical = this->up * 2.0f * std::tan(fov / 2.0f * height / width) * focusDistance;
+    lowerLeftCorner = position + forward * focusDistance - horizontal / 2.0f - vertical / 2.0f;
+}
 
-void Camera::renderScene(const Scene& scene, const std::string& filename, const std::string& renderMode, int samplesPerPixel) const {
-    std::ofstream outFile(filename);
-    if (!outFile) {
-        throw std::runtime_error("Failed to open file: " + filename);
+// Renders the frame as a series of passes over all tiles: a single pass with every
+// sample, or in progressive mode passes that double the samples per pixel, each
+// followed by an image update. Work is counted in tiles across passes, which is
+// the position checkpoints store.
+void Camera::renderScene(const Scene& scene, const std::string& filename, const RenderSettings& settings, Sampler& sampler,
+                         RenderProfile* profile) const {
+    Film film(width, height);
+    std::vector<Tile> tiles = film.makeTiles(settings.tileSize);
+    int maxSamples = settings.maxSamples();
+
+    std::vector<std::pair<int, int>> passes;
+    if (settings.progressive) {
+        for (int begin = 0; begin < maxSamples; begin = std::max(1, begin * 2)) {
+            passes.push_back({begin, std::min(std::max(1, begin * 2), maxSamples)});
+        }
+    } else {
+        passes.push_back({0, maxSamples});
     }
 
-    outFile << "P3\n" << width << " " << height << "\n255\n";
+    size_t completedTiles = 0;
+    if (settings.resume) {
+        if (loadCheckpoint(settings.checkpointFile, scene.getSource(), settings, film, completedTiles)) {
+            std::cout << "Resuming from " << settings.checkpointFile << " at tile " << completedTiles << " of "
+                      << passes.size() * tiles.size() << "\n";
+        } else {
+            std::cout << "No checkpoint at " << settings.checkpointFile << ", starting from scratch\n";
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto lastCheckpoint = start;
+    auto secondsSince = [](std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration<float>(std::chrono::steady_clock::now() - time).count();
+    };
 
-    Vector3 horizontal = right() * 2.0f * std::tan(fov / 2.0f) * focusDistance;
-    Vector3 vertical = up * 2.0f * std::tan(fov / 2.0f * height / width) * focusDistance;
-    Vector3 lowerLeftCorner = position + forward * focusDistance - horizontal / 2.0f - vertical / 2.0f;
+    bool finished = true;
+    for (size_t pass = completedTiles / tiles.size(); pass < passes.size() && finished; ++pass) {
+        for (size_t i = completedTiles % tiles.size(); i < tiles.size(); ++i) {
+            renderTile(scene, settings, sampler, tiles[i], passes[pass].first, passes[pass].second, film, profile);
+            completedTiles = pass * tiles.size() + i + 1;
+
+            if (!settings.checkpointFile.empty() && secondsSince(lastCheckpoint) >= settings.checkpointInterval) {
+                saveCheckpoint(settings.checkpointFile, scene.getSource(), settings, film, completedTiles);
+                lastCheckpoint = std::chrono::steady_clock::now();
+            }
+
+            if (settings.timeBudget > 0.0f && secondsSince(start) >= settings.timeBudget) {
+                finished = false;
+                break;
+            }
+        }
+
+        if (settings.progressive) {
+            float error = film.getAverageRelativeError();
+            std::cout << "Pass " << pass + 1 << ": " << passes[pass].second << " spp, " << secondsSince(start)
+                      << " s, average relative error " << error << std::endl;
+            writeImage(filename, film);
+
+            if (settings.noiseTarget > 0.0f && error <= settings.noiseTarget) {
+                break;
+            }
+        }
+    }
+
+    if (settings.needsAOVs()) {
+        AOVBuffers aovs = renderAOVs(scene, settings, sampler);
+        writeOutputs(filename, film, settings, &aovs);
+    } else {
+        writeOutputs(filename, film, settings);
+    }
+
+    // The image supersedes the checkpoint unless the time budget cut the render short
+    if (!settings.checkpointFile.empty()) {
+        if (finished) {
+            std::remove(settings.checkpointFile.c_str());
+        } else {
+            saveCheckpoint(settings.checkpointFile, scene.getSource(), settings, film, completedTiles);
+            std::cout << "Time budget reached, progress saved to " << settings.checkpointFile << "\n";
+        }
+    } else if (!finished) {
+        std::cout << "Time budget reached\n";
+    }
+}
+
+void Camera::renderFilm(const Scene& scene, const RenderSettings& settings, Sampler& sampler, Film& film) const {
+    for (const Tile& tile : film.makeTiles(settings.tileSize)) {
+        renderTile(scene, settings, sampler, tile, 0, settings.maxSamples(), film);
+    }
+}
+
+// Replays the first camera samples of each pixel up to their first hit. Every sample
+// counts towards the depth and normal of the pixels it hits, so silhouettes blend like
+// the image does; pixels no sample hit are marked with zero depth.
+AOVBuffers Camera::renderAOVs(const Scene& scene, const RenderSettings& settings, Sampler& sampler) const {
+    STATS_PHASE(Denoise);
+    const int AOVSamples = 16;
+    int samples = std::min(settings.maxSamples(), AOVSamples);
+
+    AOVBuffers aovs;
+    aovs.width = width;
+    aovs.height = height;
+    aovs.albedo.resize(width * height);
+    aovs.normal.resize(width * height);
+    aovs.depth.resize(width * height);
 
     for (int y = 0; y < height; ++y) {
         for (int x = 0; x < width; ++x) {
-            Color accumulatedColor = {0.0f, 0.0f, 0.0f};
+            Color albedo;
+            Vector3 normal;
+            float depth = 0.0f;
+            int hits = 0;
+            for (int sample = 0; sample < samples; ++sample) {
+                sampler.startPixelSample(x, y, sample);
+                Ray ray = generateRay(x, y, sampler);
+                STATS_ADD(CameraRays, 1);
+                HitRecord hit;
+                if (!scene.intersect(ray, std::numeric_limits<float>::max(), hit)) {
+                    continue;
+                }
+                albedo += hit.color;
+                normal = normal + (hit.normal.dot(ray.direction) > 0.0f ? -hit.normal : hit.normal);
+                depth += hit.distance;
+                ++hits;
+            }
+
+            int i = y * width + x;
+            if (hits > 0) {
+                aovs.albedo[i] = albedo * (1.0f / hits);
+                aovs.normal[i] = normal.length() > 0.0f ? normal.normalize() : normal;
+                aovs.depth[i] = depth / hits;
+            }
+        }
+    }
+    return aovs;
+}
+
+void Camera::writeOutputs(const std::string& filename, const Film& film, const RenderSettings& settings,
+                          const AOVBuffers* aovs) const {
+    if (settings.denoise && aovs) {
+        writeImage(filename, denoiseImage(film, *aovs, settings.denoiseIterations));
+    } else {
+        writeImage(filename, film);
+    }
 
-            for (int sample = 0; sample < samplesPerPixel; ++sample) {
-                float u = (x + static_cast<float>(rand()) / RAND_MAX) / (width - 1);
-                float v = (y + static_cast<float>(rand()) / RAND_MAX) / (height - 1);
+    if (settings.adaptive) {
+        std::cout << "Adaptive sampling: " << static_cast<double>(film.getTotalSamples()) / (width * height)
+                  << " samples per pixel on average\n";
+    }
 
-                Vector3 rayDirection = lowerLeftCorner + u * horizontal + v * vertical - position;
-                rayDirection = rayDirection.normalize();
+    if (!settings.heatmapFile.empty()) {
+        writeHeatmap(settings.heatmapFile, film, settings.maxSamples());
+    }
 
-                // Lens Sampling
-                Vector3 lensPoint = randomInUnitDisk() * (aperture / 2.0f);
-                Vector3 lensOffset = lensPoint.x * right() + lensPoint.y * up;
+    if (aovs && !settings.aovPrefix.empty()) {
+        writeAOVs(settings.aovPrefix, *aovs);
+    }
+}
 
-                Vector3 focalPoint = position + rayDirection * focusDistance;
-                Ray ray(position + lensOffset, (focalPoint - (position + lensOffset)).normalize());
+// Normals map [-1, 1] to [0, 1] per axis; depth is brightest at the nearest hit and
+// black where nothing was hit
+void Camera::writeAOVs(const std::string& prefix, const AOVBuffers& aovs) const {
+    float nearest = std::numeric_limits<float>::infinity(), farthest = 0.0f;
+    for (float depth : aovs.depth) {
+        if (depth > 0.0f) {
+            nearest = std::min(nearest, depth);
+            farthest = std::max(farthest, depth);
+        }
+    }
 
-                Color hdrColor;
-                if (renderMode == "binary") {
-                    hdrColor = scene.traceRay(ray) ? Color(1, 0, 0) : Color(0, 0, 0);
-                } else if (renderMode == "phong") {
-                    hdrColor = scene.traceRayWithShading(ray);
-                } else if (renderMode == "pathtracer") {
-                    hdrColor = scene.traceRayWithBRDF(ray, 5); // Depth of 5 for pathtracer
-                }
+    std::vector<Color> normals(aovs.normal.size()), depths(aovs.depth.size());
+    for (size_t i = 0; i < aovs.normal.size(); ++i) {
+        const Vector3& n = aovs.normal[i];
+        if (aovs.depth[i] > 0.0f) {
+            normals[i] = Color(n.x * 0.5f + 0.5f, n.y * 0.5f + 0.5f, n.z * 0.5f + 0.5f);
+            float shade = 1.0f - 0.9f * (aovs.depth[i] - nearest) / std::max(farthest - nearest, 1e-6f);
+            depths[i] = Color(shade, shade, shade);
+        }
+    }
 
-                accumulatedColor = accumulatedColor + hdrColor;
+    writeImage(prefix + "_albedo.ppm", aovs.albedo);
+    writeImage(prefix + "_normal.ppm", normals);
+    writeImage(prefix + "_depth.ppm", depths);
+}
+
+// The render mode is resolved once per tile; the pixel loop itself is specialised per integrator
+void Camera::renderTile(const Scene& scene, const RenderSettings& settings, Sampler& sampler, const Tile& tile,
+                        int sampleBegin, int sampleEnd, Film& film, RenderProfile* profile) const {
+    STATS_PHASE(Render);
+    CostSnapshot start = CostSnapshot::now();
+    bool found = dispatchIntegrator(settings.renderMode, [&](const auto& integrator) {
+        renderPixels(integrator, scene, settings, sampler, tile, sampleBegin, sampleEnd, film, profile);
+    });
+    if (!found) {
+        throw std::runtime_error("Unknown render mode: " + settings.renderMode);
+    }
+
+    if (profile) {
+        profile->addTile(profile->currentThreadTrack(), tile, sampleBegin, sampleEnd, start.time, start.elapsed());
+    }
+}
+
+// Adds samples [sampleBegin, sampleEnd) of every pixel in the tile. Adaptive pixels stop
+// early once the film reports them converged, counting samples from earlier calls too.
+template <typename Integrator>
+void Camera::renderPixels(const Integrator& integrator, const Scene& scene, const RenderSettings& settings,
+                          Sampler& sampler, const Tile& tile, int sampleBegin, int sampleEnd, Film& film,
+                          RenderProfile* profile) const {
+    int minSamples = std::clamp(settings.minSamplesPerPixel, 1, settings.maxSamples());
+    bool pixelCosts = profile && profile->capturesPixels();
+
+    for (int y = tile.y0; y < tile.y1; ++y) {
+        for (int x = tile.x0; x < tile.x1; ++x) {
+            CostSnapshot pixelStart;
+            if (pixelCosts) {
+                pixelStart = CostSnapshot::now();
             }
 
-            Color averagedColor = accumulatedColor * (1.0f / samplesPerPixel);
-            Color mappedColor = toneMap(averagedColor);
+            for (int sample = sampleBegin; sample < sampleEnd; ++sample) {
+                if (settings.adaptive && film.isConverged(x, y, minSamples, settings.errorThreshold)) {
+                    break;
+                }
+
+                sampler.startPixelSample(x, y, sample);
+                Ray ray = generateRay(x, y, sampler);
+                STATS_ADD(CameraRays, 1);
+                film.addSample(x, y, integrator.Li(scene, ray, sampler));
+            }
 
-            outFile << static_cast<int>(std::clamp(mappedColor.r * 255.0f, 0.0f, 255.0f)) << " "
-                    << static_cast<int>(std::clamp(mappedColor.g * 255.0f, 0.0f, 255.0f)) << " "
-                    << static_cast<int>(std::clamp(mappedColor.b * 255.0f, 0.0f, 255.0f)) << " ";
+            if (pixelCosts) {
+                profile->addPixel(x, y, pixelStart.elapsed());
+            }
         }
-        outFile << "\n";
     }
+}
+
+// Thin-lens camera ray through a jittered position in pixel (x, y), with differentials
+// for the same film and lens position one pixel over in x and y
+Ray Camera::generateRay(int x, int y, Sampler& sampler) const {
+    float jitterX, jitterY;
+    sampler.get2D(jitterX, jitterY);
+    float u = (x + jitterX) / (width - 1);
+    float v = (y + jitterY) / (height - 1);
+
+    // Lens Sampling
+    float lensU, lensV;
+    sampler.get2D(lensU, lensV);
+    Vector3 lensPoint = sampleUnitDisk(lensU, lensV) * (aperture / 2.0f);
+    Vector3 lensOrigin = position + lensPoint.x * rightVector + lensPoint.y * up;
 
-    outFile.close();
+    // Every film position is in focus on the plane focusDistance away along its pinhole ray
+    auto throughLens = [&](float filmU, float filmV) {
+        Vector3 pinholeDirection = (lowerLeftCorner + filmU * horizontal + filmV * vertical - position).normalize();
+        Vector3 focalPoint = position + pinholeDirection * focusDistance;
+        return (focalPoint - lensOrigin).normalize();
+    };
+
+    Ray ray(lensOrigin, throughLens(u, v));
+    ray.hasDifferentials = true;
+    ray.dxOrigin = lensOrigin;
+    ray.dyOrigin = lensOrigin;
+    ray.dxDirection = throughLens(u + 1.0f / (width - 1), v);
+    ray.dyDirection = throughLens(u, v + 1.0f / (height - 1));
+    return ray;
 }
 
-Vector3 Camera::right() const {
-    return forward.cross(up).normalize();
+void Camera::writeImage(const std::string& filename, const Film& film) const {
+    std::vector<Color> pixels(width * height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            pixels[y * width + x] = film.getPixel(x, y);
+        }
+    }
+    writeImage(filename, pixels);
 }
 
-Vector3 Camera::randomInUnitDisk() const {
-    std::mt19937 generator(std::random_device{}());
-    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+// Written to a temporary file and renamed over the target, so viewers never see a
+// partially written image
+void Camera::writeImage(const std::string& filename, const std::vector<Color>& pixels) const {
+    STATS_PHASE(Output);
+    std::string temporary = filename + ".tmp";
+    {
+        std::ofstream outFile(temporary);
+        if (!outFile) {
+            throw std::runtime_error("Failed to open file: " + temporary);
+        }
+
+        outFile << "P3\n" << width << " " << height << "\n255\n";
+
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                Color mappedColor = toneMap(pixels[y * width + x]);
 
-    while (true) {
-        float x = dist(generator);
-        float y = dist(generator);
-        if (x * x + y * y <= 1.0f) {
-            return {x, y, 0.0f};
+                outFile << static_cast<int>(std::clamp(mappedColor.r * 255.0f, 0.0f, 255.0f)) << " "
+                        << static_cast<int>(std::clamp(mappedColor.g * 255.0f, 0.0f, 255.0f)) << " "
+                        << static_cast<int>(std::clamp(mappedColor.b * 255.0f, 0.0f, 255.0f)) << " ";
+            }
+            outFile << "\n";
         }
+
+        if (!outFile) {
+            throw std::runtime_error("Failed to write file: " + temporary);
+        }
+    }
+
+    if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+        throw std::runtime_error("Failed to replace file: " + filename);
+    }
+}
+
+// Concentric mapping of the unit square onto the unit disk; unlike rejection
+// sampling it keeps the stratification of the input sample
+Vector3 Camera::sampleUnitDisk(float u, float v) const {
+    float offsetX = 2.0f * u - 1.0f;
+    float offsetY = 2.0f * v - 1.0f;
+    if (offsetX == 0.0f && offsetY == 0.0f) {
+        return {0.0f, 0.0f, 0.0f};
+    }
+
+    float r, theta;
+    if (std::abs(offsetX) > std::abs(offsetY)) {
+        r = offsetX;
+        theta = static_cast<float>(M_PI / 4) * (offsetY / offsetX);
+    } else {
+        r = offsetY;
+        theta = static_cast<float>(M_PI / 2) - static_cast<float>(M_PI / 4) * (offsetX / offsetY);
     }
+    return {r * std::cos(theta), r * std::sin(theta), 0.0f};
 }
 
 Color Camera::toneMap(const Color& hdrColor) const {
@@ -87,3 +357,25 @@ Color Camera::toneMap(const Color& hdrColor) const {
     }
     return hdrColor;
 }
+
+// False-colour image of the samples spent per pixel: blue is few, red is maxSamples
+void Camera::writeHeatmap(const std::string& filename, const Film& film, int maxSamples) const {
+    STATS_PHASE(Output);
+    std::ofstream outFile(filename);
+    if (!outFile) {
+        throw std::runtime_error("Failed to open file: " + filename);
+    }
+
+    outFile << "P3\n" << width << " " << height << "\n255\n";
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            Color heat = heatColor(static_cast<float>(film.getSampleCount(x, y)) / maxSamples);
+
+            outFile << static_cast<int>(heat.r * 255.0f) << " "
+                    << static_cast<int>(heat.g * 255.0f) << " "
+                    << static_cast<int>(heat.b * 255.0f) << " ";
+        }
+        outFile << "\n";
+    }
+}
@@ -4,22 +4,58 @@
 #include "vector3.h"
 #include "ray.h"
 #include "color.h"
+#include "sampler.h"
+#include "rendersettings.h"
+#include "film.h"
+#include "denoiser.h"
 #include <string>
 
 class Scene;
+class RenderProfile;
 
 class Camera {
 public:
     Camera(Vector3 position, Vector3 direction, Vector3 up, float fov, int width, int height, float aperture, float focusDistance);
-    void renderScene(const Scene& scene, const std::string& filename, const std::string& renderMode, int samplesPerPixel) const;
+    // Records tile and pixel costs into profile when given
+    void renderScene(const Scene& scene, const std::string& filename, const RenderSettings& settings, Sampler& sampler,
+                     RenderProfile* profile = nullptr) const;
+    // All samples of every tile, without checkpoints or image output
+    void renderFilm(const Scene& scene, const RenderSettings& settings, Sampler& sampler, Film& film) const;
+    void renderTile(const Scene& scene, const RenderSettings& settings, Sampler& sampler, const Tile& tile,
+                    int sampleBegin, int sampleEnd, Film& film, RenderProfile* profile = nullptr) const;
+    // First-hit albedo, normal and depth of each pixel, averaged over the pixel's first
+    // samples; these are the same camera rays as the image's, so edges line up
+    AOVBuffers renderAOVs(const Scene& scene, const RenderSettings& settings, Sampler& sampler) const;
+    // Image (denoised when settings ask and aovs are given), adaptive sampling summary,
+    // heatmap and AOV images of a finished film
+    void writeOutputs(const std::string& filename, const Film& film, const RenderSettings& settings,
+                      const AOVBuffers* aovs = nullptr) const;
+    void writeImage(const std::string& filename, const Film& film) const;
+    void writeImage(const std::string& filename, const std::vector<Color>& pixels) const;
+    void writeHeatmap(const std::string& filename, const Film& film, int maxSamples) const;
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    const Vector3& getPosition() const { return position; }
+    const Vector3& getDirection() const { return forward; }
+    const Vector3& getUp() const { return up; }
+    float getFov() const { return fov; }
+    float getAperture() const { return aperture; }
+    float getFocusDistance() const { return focusDistance; }
 
 private:
     Vector3 position, forward, up;
     float fov, aperture, focusDistance;
     int width, height;
-    Vector3 right() const;
-    Vector3 randomInUnitDisk() const;
+    Vector3 rightVector, horizontal, vertical, lowerLeftCorner;
+
+    template <typename Integrator>
+    void renderPixels(const Integrator& integrator, const Scene& scene, const RenderSettings& settings,
+                      Sampler& sampler, const Tile& tile, int sampleBegin, int sampleEnd, Film& film,
+                      RenderProfile* profile) const;
+    Ray generateRay(int x, int y, Sampler& sampler) const;
+    Vector3 sampleUnitDisk(float u, float v) const;
     Color toneMap(const Color& hdrColor) const;
+    void writeAOVs(const std::string& prefix, const AOVBuffers& aovs) const;
 };
 
 #endif
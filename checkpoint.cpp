@@ -0,0 +1,129 @@
+#include "checkpoint.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+const char Magic[4] = {'R', 'T', 'C', 'K'};
+const uint32_t Version = 3;
+
+// Everything that changes which samples end up in the film. Streaming textures from
+// the tile cache gives the same texels as resident ones, so the cache budget is left out.
+std::string settingsKey(const std::string& sceneSource, const RenderSettings& settings, const Film& film) {
+    std::ostringstream key;
+    key << sceneSource << ' ' << settings.renderMode << ' ' << settings.samplesPerPixel << ' ' << settings.samplerName << ' '
+        << settings.seed << ' ' << settings.lightSamplerName << ' ' << settings.textureFormat << ' ' << settings.tileSize << ' '
+        << settings.adaptive << ' ' << settings.minSamplesPerPixel << ' ' << settings.maxSamplesPerPixel << ' '
+        << settings.errorThreshold << ' ' << settings.progressive << ' ' << film.getWidth() << 'x' << film.getHeight();
+    return key.str();
+}
+
+template <typename T>
+void writeValue(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+void readValue(std::istream& in, T& value) {
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+void writeString(std::ostream& out, const std::string& value) {
+    writeValue(out, static_cast<uint64_t>(value.size()));
+    out.write(value.data(), value.size());
+}
+
+std::string readString(std::istream& in) {
+    uint64_t size = 0;
+    readValue(in, size);
+    if (!in || size > (1u << 30)) {
+        throw std::runtime_error("Corrupt checkpoint");
+    }
+    std::string value(size, '\0');
+    in.read(&value[0], size);
+    return value;
+}
+
+} // namespace
+
+// Written next to the target and renamed over it, so a crash mid-write keeps the previous checkpoint
+void saveCheckpoint(const std::string& filename, const std::string& sceneSource, const RenderSettings& settings,
+                    const Film& film, size_t completedTiles) {
+    std::string temporary = filename + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        if (!out) {
+            throw std::runtime_error("Failed to open file: " + temporary);
+        }
+
+        out.write(Magic, sizeof(Magic));
+        writeValue(out, Version);
+        writeString(out, settingsKey(sceneSource, settings, film));
+        writeValue(out, static_cast<uint64_t>(completedTiles));
+
+        for (int y = 0; y < film.getHeight(); ++y) {
+            for (int x = 0; x < film.getWidth(); ++x) {
+                const FilmPixel& pixel = film.getPixelData(x, y);
+                writeValue(out, pixel.colorSum);
+                writeValue(out, pixel.samples);
+                writeValue(out, pixel.luminanceSum);
+                writeValue(out, pixel.luminanceSquaredSum);
+            }
+        }
+
+        out.flush();
+        if (!out) {
+            throw std::runtime_error("Failed to write checkpoint: " + temporary);
+        }
+    }
+
+    if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+        throw std::runtime_error("Failed to replace checkpoint: " + filename);
+    }
+}
+
+bool loadCheckpoint(const std::string& filename, const std::string& sceneSource, const RenderSettings& settings,
+                    Film& film, size_t& completedTiles) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    in.read(magic, sizeof(magic));
+    readValue(in, version);
+    if (!in || !std::equal(magic, magic + 4, Magic) || version != Version) {
+        throw std::runtime_error("Not a render checkpoint: " + filename);
+    }
+
+    if (readString(in) != settingsKey(sceneSource, settings, film)) {
+        throw std::runtime_error("Checkpoint was written for a different scene or render settings: " + filename);
+    }
+
+    uint64_t tiles = 0;
+    readValue(in, tiles);
+
+    for (int y = 0; y < film.getHeight(); ++y) {
+        for (int x = 0; x < film.getWidth(); ++x) {
+            FilmPixel pixel;
+            readValue(in, pixel.colorSum);
+            readValue(in, pixel.samples);
+            readValue(in, pixel.luminanceSum);
+            readValue(in, pixel.luminanceSquaredSum);
+            film.mergePixel(x, y, pixel);
+        }
+    }
+
+    if (!in) {
+        throw std::runtime_error("Truncated checkpoint: " + filename);
+    }
+
+    completedTiles = static_cast<size_t>(tiles);
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "film.h"
+#include "rendersettings.h"
+#include <string>
+
+// Snapshot of a render that fills the film tile by tile in makeTiles order, pass
+// after pass: the accumulated film and the number of finished tiles. Samplers are
+// stateless, so resuming reproduces the uninterrupted render exactly. Checkpoints
+// only resume for the same scene (see Scene::getSource) under the settings they
+// were written with.
+void saveCheckpoint(const std::string& filename, const std::string& sceneSource, const RenderSettings& settings,
+                    const Film& film, size_t completedTiles);
+
+// Returns false if the file does not exist; throws if it belongs to another render
+bool loadCheckpoint(const std::string& filename, const std::string& sceneSource, const RenderSettings& settings,
+                    Film& film, size_t& completedTiles);
+
+#endif
@@ -1,37 +1,63 @@
 #ifndef COLOR_H
 #define COLOR_H
 
-struct Color {
-    float r, g, b;
+#include "vector3.h"
 
-    Color(float r = 0, float g = 0, float b = 0) : r(r), g(g), b(b) {}
+// Float4-backed RGB color; the padding lane keeps it in one 16-byte register
+struct alignas(16) Color {
+    float r, g, b, a;
+
+    Color(float r = 0, float g = 0, float b = 0) : r(r), g(g), b(b), a(0) {}
+
+#ifdef VECTOR3_SSE
+    explicit Color(__m128 v) { _mm_store_ps(&r, v); }
+    __m128 simd() const { return _mm_load_ps(&r); }
+#endif
 
     // Addition of two colors
     Color operator+(const Color &other) const {
+#ifdef VECTOR3_SSE
+        return Color(_mm_add_ps(simd(), other.simd()));
+#else
         return Color(r + other.r, g + other.g, b + other.b);
+#endif
     }
 
     // Multiplication of color by a scalar
     Color operator*(float scalar) const {
+#ifdef VECTOR3_SSE
+        return Color(_mm_mul_ps(simd(), _mm_set1_ps(scalar)));
+#else
         return Color(r * scalar, g * scalar, b * scalar);
+#endif
     }
 
     // Multiplication of two colors (component-wise)
     Color operator*(const Color &other) const {
+#ifdef VECTOR3_SSE
+        return Color(_mm_mul_ps(simd(), other.simd()));
+#else
         return Color(r * other.r, g * other.g, b * other.b);
+#endif
     }
 
      // Overload division operator for scalar
     Color operator/(float scalar) const {
-        return Color(r / scalar, g / scalar, b / scalar);
+        return (*this) * (1.0f / scalar);
     }
 
     // Compound addition assignment
     Color& operator+=(const Color &other) {
-        r += other.r;
-        g += other.g;
-        b += other.b;
-        return *this;
+        return *this = *this + other;
+    }
+
+    // Fused multiply-add: a * b + c, e.g. accumulating weighted radiance
+    static Color madd(const Color &a, const Color &b, const Color &c) {
+#ifdef VECTOR3_SSE
+        return Color(_mm_add_ps(_mm_mul_ps(a.simd(), b.simd()), c.simd()));
+#else
+        return Color(a.r * b.r + c.r, a.g * b.g + c.g, a.b * b.b + c.b);
+#endif
     }
 };
 
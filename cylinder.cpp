@@ -1,173 +1,143 @@
 #include "cylinder.h"
 #include "boundingbox.h"
 #include <cmath>
-
-Cylinder::Cylinder(const Vector3 &c, const Vector3 &a, float r, float h, const Color &col,
-                   float reflectivity, float transparency, float refractiveIndex, Texture* texture)
-    : center(c), axis(a.normalize()), radius(r), height(h), color(col), reflectivity(reflectivity),
-      transparency(transparency), refractiveIndex(refractiveIndex), texture(texture) {}
+#include <algorithm>
+
+Cylinder::Cylinder(const Vector3 &c, const Vector3 &a, float r, float h, MaterialId materialId)
+    : center(c), axis(a.normalize()), radius(r), height(h), materialId(materialId) {
+    halfHeight = height / 2;
+    radiusSquared = radius * radius;
+    inverseRadius = 1.0f / radius;
+    topCenter = center + axis * halfHeight;
+    bottomCenter = center - axis * halfHeight;
+
+    tangent = (std::abs(axis.x) > 0.9f ? Vector3(0, 1, 0) : Vector3(1, 0, 0)).cross(axis).normalize();
+    bitangent = axis.cross(tangent);
+}
 
 bool Cylinder::doesIntersect(const Ray &ray) const {
-    Vector3 oc = ray.origin - center;
-    Vector3 d = ray.direction - axis * ray.direction.dot(axis);
-    Vector3 o = oc - axis * oc.dot(axis);
-
-    float a = d.dot(d);
-    float b = 2.0f * o.dot(d);
-    float c = o.dot(o) - radius * radius;
-
-    float discriminant = b * b - 4 * a * c;
-    bool hitCurvedSurface = false;
-
-    float t = -1.0f;
-
-    if (discriminant >= 0) {
-        float t1 = (-b - std::sqrt(discriminant)) / (2.0f * a);
-        float t2 = (-b + std::sqrt(discriminant)) / (2.0f * a);
-
-        t = (t1 > 1e-6f) ? t1 : ((t2 > 1e-6f) ? t2 : -1.0f);
-
-        if (t > 1e-6f) {
-            Vector3 intersection = ray.origin + ray.direction * t;
-            float heightCheck = (intersection - center).dot(axis);
-            if (heightCheck >= -height / 2 && heightCheck <= height / 2) {
-                hitCurvedSurface = true;
-            }
-        }
-    }
-
-    float tTop = ((center + axis * (height / 2)) - ray.origin).dot(axis) /
-                 ray.direction.dot(axis);
-    bool hitTop = false;
-
-    if (tTop > 1e-6f) {
-        Vector3 p = ray.origin + ray.direction * tTop;
-        if ((p - (center + axis * (height / 2))).length() <= radius) {
-            hitTop = true;
-            t = (t < 0 || tTop < t) ? tTop : t;
-        }
-    }
-
-    float tBottom = ((center - axis * (height / 2)) - ray.origin).dot(axis) /
-                    ray.direction.dot(axis);
-    bool hitBottom = false;
-
-    if (tBottom > 1e-6f) {
-        Vector3 p = ray.origin + ray.direction * tBottom;
-        if ((p - (center - axis * (height / 2))).length() <= radius) {
-            hitBottom = true;
-            t = (t < 0 || tBottom < t) ? tBottom : t;
-        }
-    }
-
-    return hitCurvedSurface || hitTop || hitBottom;
+    Part part;
+    return intersect(ray, part) > 0;
 }
 
 float Cylinder::getIntersectionDistance(const Ray &ray) const {
+    Part part;
+    return intersect(ray, part);
+}
+
+// Closest hit against the side and both caps, worked out in the axis frame so only
+// one square root is needed. Returns -1 on a miss.
+float Cylinder::intersect(const Ray &ray, Part &part) const {
     Vector3 oc = ray.origin - center;
-    Vector3 d = ray.direction - axis * ray.direction.dot(axis);
-    Vector3 o = oc - axis * oc.dot(axis);
+    float originHeight = oc.dot(axis);
+    float directionHeight = ray.direction.dot(axis);
 
-    float a = d.dot(d);
-    float b = 2.0f * o.dot(d);
-    float c = o.dot(o) - radius * radius;
+    // Ray components perpendicular to the axis
+    Vector3 o = oc - axis * originHeight;
+    Vector3 d = ray.direction - axis * directionHeight;
 
-    float discriminant = b * b - 4 * a * c;
     float t = -1.0f;
+    part = None;
 
-    if (discriminant >= 0) {
-        float t1 = (-b - std::sqrt(discriminant)) / (2.0f * a);
-        float t2 = (-b + std::sqrt(discriminant)) / (2.0f * a);
-
-        t = (t1 > 1e-6f) ? t1 : ((t2 > 1e-6f) ? t2 : -1.0f);
-
-        if (t > 1e-6f) {
-            Vector3 intersection = ray.origin + ray.direction * t;
-            float heightCheck = (intersection - center).dot(axis);
-            if (heightCheck < -height / 2 || heightCheck > height / 2) {
-                t = -1.0f;
+    // Curved surface
+    float a = d.dot(d);
+    if (a > 1e-12f) {
+        float b = o.dot(d);
+        float c = o.dot(o) - radiusSquared;
+        float discriminant = b * b - a * c;
+
+        if (discriminant >= 0) {
+            float root = std::sqrt(discriminant);
+            float inverseA = 1.0f / a;
+            float t1 = (-b - root) * inverseA;
+            float t2 = (-b + root) * inverseA;
+
+            if (t1 > ray.tMin && std::abs(originHeight + t1 * directionHeight) <= halfHeight) {
+                t = t1;
+                part = Side;
+            } else if (t2 > ray.tMin && std::abs(originHeight + t2 * directionHeight) <= halfHeight) {
+                t = t2;
+                part = Side;
             }
         }
     }
 
-    float tTop = ((center + axis * (height / 2)) - ray.origin).dot(axis) /
-                 ray.direction.dot(axis);
-    if (tTop > 1e-6f) {
-        Vector3 p = ray.origin + ray.direction * tTop;
-        if ((p - (center + axis * (height / 2))).length() <= radius) {
-            t = (t < 0 || tTop < t) ? tTop : t;
+    // Caps
+    if (std::abs(directionHeight) > 1e-12f) {
+        float inverseDirectionHeight = 1.0f / directionHeight;
+
+        float tTop = (halfHeight - originHeight) * inverseDirectionHeight;
+        if (tTop > ray.tMin && (t < 0 || tTop < t)) {
+            Vector3 p = Vector3::madd(d, tTop, o);
+            if (p.dot(p) <= radiusSquared) {
+                t = tTop;
+                part = Top;
+            }
         }
-    }
 
-    float tBottom = ((center - axis * (height / 2)) - ray.origin).dot(axis) /
-                    ray.direction.dot(axis);
-    if (tBottom > 1e-6f) {
-        Vector3 p = ray.origin + ray.direction * tBottom;
-        if ((p - (center - axis * (height / 2))).length() <= radius) {
-            t = (t < 0 || tBottom < t) ? tBottom : t;
+        float tBottom = (-halfHeight - originHeight) * inverseDirectionHeight;
+        if (tBottom > ray.tMin && (t < 0 || tBottom < t)) {
+            Vector3 p = Vector3::madd(d, tBottom, o);
+            if (p.dot(p) <= radiusSquared) {
+                t = tBottom;
+                part = Bottom;
+            }
         }
     }
 
     return t;
 }
 
-Vector3 Cylinder::getNormal(const Vector3 &point) const {
-    Vector3 projection = axis * ((point - center).dot(axis));
-    float heightCheck = (point - center).dot(axis);
-
-    if (std::abs(heightCheck - height / 2) < 1e-6f) {
+Vector3 Cylinder::getNormal(const Vector3 &point, Part part) const {
+    if (part == Top) {
         return axis;
-    } else if (std::abs(heightCheck + height / 2) < 1e-6f) {
+    } else if (part == Bottom) {
         return -axis;
     }
 
-    return (point - center - projection).normalize(); // Curved surface
+    // Curved surface: the radial offset has length radius
+    Vector3 local = point - center;
+    return (local - axis * local.dot(axis)) * inverseRadius;
 }
 
-Color Cylinder::getColor(const Vector3 &point) const {
-    if (texture) {
-        float heightCheck = (point - center).dot(axis);
-        Vector3 local;
-
-        if (std::abs(heightCheck - height / 2) < 1e-6f) {
-            // Map texture for the top surface
-            local = point - (center + axis * (height / 2));
-            float u = (local.x / radius + 1.0f) * 0.5f;
-            float v = (local.y / radius + 1.0f) * 0.5f;
-            return texture->getColorAt(u, v);
-        } else if (std::abs(heightCheck + height / 2) < 1e-6f) {
-            // Map texture for the bottom surface
-            local = point - (center - axis * (height / 2));
-            float u = (local.x / radius + 1.0f) * 0.5f;
-            float v = (local.y / radius + 1.0f) * 0.5f;
-            return texture->getColorAt(u, v);
-        } else {
-            // Map texture for the curved surface
-            float theta = std::atan2(point.z - center.z, point.x - center.x);
-            if (theta < 0) theta += 2 * M_PI;
-            float v = (heightCheck + height / 2) / height;
-            float u = theta / (2 * M_PI);
-            return texture->getColorAt(u, v);
-        }
+Vector3 Cylinder::projectToSurface(const Vector3 &point, Part part) const {
+    if (part != Side) {
+        return point;
     }
-    return color;
-}
 
-float Cylinder::getReflectivity() const {
-    return reflectivity;
+    Vector3 local = point - center;
+    Vector3 along = axis * local.dot(axis);
+    Vector3 radial = local - along;
+    return center + along + radial * (radius / radial.length());
 }
 
-float Cylinder::getTransparency() const {
-    return transparency;
+void Cylinder::getTextureCoordinates(const Vector3 &point, Part part, float &u, float &v) const {
+    if (part == Top || part == Bottom) {
+        // Map texture for the caps in the local frame
+        Vector3 local = point - (part == Top ? topCenter : bottomCenter);
+        u = (local.dot(tangent) * inverseRadius + 1.0f) * 0.5f;
+        v = (local.dot(bitangent) * inverseRadius + 1.0f) * 0.5f;
+    } else {
+        // Map texture for the curved surface
+        Vector3 local = point - center;
+        float theta = std::atan2(local.dot(bitangent), local.dot(tangent));
+        if (theta < 0) theta += 2 * M_PI;
+        u = theta / (2 * M_PI);
+        v = (local.dot(axis) + halfHeight) / height;
+    }
 }
 
-float Cylinder::getRefractiveIndex() const {
-    return refractiveIndex;
+MaterialId Cylinder::getMaterialId() const {
+    return materialId;
 }
 
+// Tight box: along each world axis the caps reach halfHeight * |axis| and the rim
+// radius * sqrt(1 - axis^2)
 BoundingBox Cylinder::getBoundingBox() const {
-    Vector3 radiusVector(radius, radius, radius);
-    Vector3 min = center - radiusVector - axis * (height / 2);
-    Vector3 max = center + radiusVector + axis * (height / 2);
-    return BoundingBox(min, max);
+    Vector3 extent(
+        halfHeight * std::abs(axis.x) + radius * std::sqrt(std::max(0.0f, 1.0f - axis.x * axis.x)),
+        halfHeight * std::abs(axis.y) + radius * std::sqrt(std::max(0.0f, 1.0f - axis.y * axis.y)),
+        halfHeight * std::abs(axis.z) + radius * std::sqrt(std::max(0.0f, 1.0f - axis.z * axis.z))
+    );
+    return BoundingBox(center - extent, center + extent);
 }
@@ -3,23 +3,24 @@
 
 #include "vector3.h"
 #include "ray.h"
-#include "color.h"
-#include "texture.h"
+#include "material.h"
 #include "boundingbox.h"
 
 class Cylinder {
 public:
-    Cylinder(const Vector3 &c, const Vector3 &a, float r, float h, const Color &color,
-             float reflectivity = 0.0f, float transparency = 0.0f,
-             float refractiveIndex = 1.0f, Texture* texture = nullptr);
+    // Surface hit by a ray, so shading does not have to classify the hit point again
+    enum Part { None = 0, Side, Top, Bottom };
+
+    Cylinder(const Vector3 &c, const Vector3 &a, float r, float h, MaterialId materialId = 0);
 
     bool doesIntersect(const Ray &ray) const;
     float getIntersectionDistance(const Ray &ray) const;
-    Vector3 getNormal(const Vector3 &point) const;
-    Color getColor(const Vector3 &hitPoint) const;
-    float getReflectivity() const;
-    float getTransparency() const;
-    float getRefractiveIndex() const;
+    float intersect(const Ray &ray, Part &part) const;
+    Vector3 getNormal(const Vector3 &point, Part part) const;
+    // Hit point on the curved surface moved back to the exact radius; cap points are kept
+    Vector3 projectToSurface(const Vector3 &point, Part part) const;
+    void getTextureCoordinates(const Vector3 &point, Part part, float &u, float &v) const;
+    MaterialId getMaterialId() const;
     BoundingBox getBoundingBox() const;
 
 private:
@@ -27,11 +28,14 @@ private:
     Vector3 axis;
     float radius;
     float height;
-    Color color;
-    float reflectivity;
-    float transparency;
-    float refractiveIndex;
-    Texture* texture;
+    MaterialId materialId;
+
+    // Derived at construction
+    float halfHeight;
+    float radiusSquared;
+    float inverseRadius;
+    Vector3 topCenter, bottomCenter;
+    Vector3 tangent, bitangent; // With axis, an orthonormal local frame
 };
 
 #endif
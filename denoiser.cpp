@@ -0,0 +1,158 @@
+#include "denoiser.h"
+#include "stats.h"
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+
+// Edge-stopping parameters
+const float LuminancePhi = 4.0f;  // Luminance difference, in estimated standard deviations
+const int NormalPowerLog2 = 6;    // Exponent on the cosine between normals, 2^6 = 64
+const float DepthPhi = 0.02f;     // Depth difference relative to depth, per step of spacing
+const float AlbedoPhi = 0.1f;     // Albedo difference
+
+// B3-spline weights for offsets 0, 1 and 2
+const float Kernel[3] = {3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+
+float luminance(const Color& color) {
+    return 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+}
+
+// Calls function(y) for every row, on one band of rows per hardware thread. Rows only
+// read the previous pass, so the result does not depend on the thread count.
+template <typename Function>
+void forEachRow(int height, const Function& function) {
+    int bands = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::future<void>> pending;
+    for (int band = 0; band < bands; ++band) {
+        int begin = height * band / bands, end = height * (band + 1) / bands;
+        pending.push_back(std::async(std::launch::async, [&function, begin, end] {
+            for (int y = begin; y < end; ++y) {
+                function(y);
+            }
+        }));
+    }
+    for (std::future<void>& band : pending) {
+        band.get();
+    }
+}
+
+} // namespace
+
+std::vector<Color> denoiseImage(const Film& film, const AOVBuffers& aovs, int iterations) {
+    STATS_PHASE(Denoise);
+    if (iterations < 1 || iterations > RenderSettings::MaxDenoiseIterations) {
+        throw std::runtime_error("Denoiser iterations out of range: " + std::to_string(iterations));
+    }
+    int width = aovs.width, height = aovs.height;
+    size_t count = static_cast<size_t>(width) * height;
+
+    // Untextured irradiance: the image divided by the albedo wherever that is not black.
+    // The noise estimate is the variance of the pixel's mean luminance, scaled alike.
+    std::vector<Color> demodulation(count), irradiance(count);
+    std::vector<float> variance(count);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            size_t i = static_cast<size_t>(y) * width + x;
+            const Color& albedo = aovs.albedo[i];
+            auto divisor = [](float channel) { return channel > 1e-3f ? channel : 1.0f; };
+            demodulation[i] = Color(divisor(albedo.r), divisor(albedo.g), divisor(albedo.b));
+
+            Color color = film.getPixel(x, y);
+            irradiance[i] = Color(color.r / demodulation[i].r, color.g / demodulation[i].g, color.b / demodulation[i].b);
+
+            const FilmPixel& pixel = film.getPixelData(x, y);
+            int n = pixel.samples;
+            double pixelVariance = 1.0;
+            if (n >= 2) {
+                double mean = pixel.luminanceSum / n;
+                pixelVariance = std::max(0.0, (pixel.luminanceSquaredSum - mean * pixel.luminanceSum) / (n - 1)) / n;
+            }
+            float scale = luminance(demodulation[i]);
+            variance[i] = static_cast<float>(pixelVariance / (scale * scale));
+        }
+    }
+
+    std::vector<Color> filtered(count);
+    std::vector<float> filteredVariance(count), blurredVariance(count);
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        int step = 1 << iteration;
+
+        // The luminance edge stop uses a 3x3 blur of the variance, which is itself noisy
+        forEachRow(height, [&](int y) {
+            for (int x = 0; x < width; ++x) {
+                float sum = 0.0f, weight = 0.0f;
+                for (int dy = -1; dy <= 1; ++dy) {
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        int qx = x + dx, qy = y + dy;
+                        if (qx < 0 || qy < 0 || qx >= width || qy >= height) continue;
+                        float w = Kernel[std::abs(dx)] * Kernel[std::abs(dy)];
+                        sum += w * variance[static_cast<size_t>(qy) * width + qx];
+                        weight += w;
+                    }
+                }
+                blurredVariance[static_cast<size_t>(y) * width + x] = sum / weight;
+            }
+        });
+
+        forEachRow(height, [&](int y) {
+            for (int x = 0; x < width; ++x) {
+                size_t p = static_cast<size_t>(y) * width + x;
+                bool hitP = aovs.depth[p] > 0.0f;
+                float luminanceP = luminance(irradiance[p]);
+                float luminanceScale = 1.0f / (LuminancePhi * std::sqrt(blurredVariance[p]) + 1e-4f);
+                float depthScale = 1.0f / (DepthPhi * aovs.depth[p] * step + 1e-6f);
+
+                Color sum;
+                float weightSum = 0.0f, varianceSum = 0.0f;
+                for (int dy = -2; dy <= 2; ++dy) {
+                    for (int dx = -2; dx <= 2; ++dx) {
+                        int qx = x + dx * step, qy = y + dy * step;
+                        if (qx < 0 || qy < 0 || qx >= width || qy >= height) continue;
+                        size_t q = static_cast<size_t>(qy) * width + qx;
+
+                        // Surfaces and background are never mixed
+                        if (hitP != (aovs.depth[q] > 0.0f)) continue;
+
+                        float w = Kernel[std::abs(dx)] * Kernel[std::abs(dy)];
+                        if (q != p) {
+                            float exponent = std::abs(luminanceP - luminance(irradiance[q])) * luminanceScale;
+                            if (hitP) {
+                                const Color& a = aovs.albedo[p];
+                                const Color& b = aovs.albedo[q];
+                                float albedoDistance = std::abs(a.r - b.r) + std::abs(a.g - b.g) + std::abs(a.b - b.b);
+                                exponent += std::abs(aovs.depth[p] - aovs.depth[q]) * depthScale + albedoDistance / AlbedoPhi;
+                                float cosine = std::max(0.0f, aovs.normal[p].dot(aovs.normal[q]));
+                                for (int i = 0; i < NormalPowerLog2; ++i) {
+                                    cosine *= cosine;
+                                }
+                                w *= cosine;
+                            }
+                            w *= std::exp(-exponent);
+                        }
+
+                        sum += irradiance[q] * w;
+                        weightSum += w;
+                        varianceSum += w * w * variance[q];
+                    }
+                }
+
+                // The centre tap always contributes, so weightSum is positive
+                filtered[p] = sum * (1.0f / weightSum);
+                filteredVariance[p] = varianceSum / (weightSum * weightSum);
+            }
+        });
+
+        std::swap(irradiance, filtered);
+        std::swap(variance, filteredVariance);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        irradiance[i] = irradiance[i] * demodulation[i];
+    }
+    return irradiance;
+}
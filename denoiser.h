@@ -0,0 +1,27 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include "color.h"
+#include "film.h"
+#include "rendersettings.h"
+#include "vector3.h"
+#include <vector>
+
+// First-hit feature buffers of a frame (arbitrary output variables), each pixel the
+// mean over its camera samples. Pixels whose rays all escaped have zero normal and depth.
+struct AOVBuffers {
+    int width = 0, height = 0;
+    std::vector<Color> albedo;
+    std::vector<Vector3> normal; // Facing the camera
+    std::vector<float> depth;    // Distance along the camera ray
+};
+
+// Edge-avoiding à-trous wavelet filter (Dammertz et al. 2010) of the film's image:
+// `iterations` passes of a 5x5 B3-spline kernel with doubling spacing, whose taps are
+// stopped at normal, depth and albedo edges and at luminance differences large against
+// the pixel's estimated noise (as in SVGF). Filtering happens on the image divided by
+// the albedo, so texture detail survives, and rows are filtered in parallel.
+// Throws unless 1 <= iterations <= RenderSettings::MaxDenoiseIterations.
+std::vector<Color> denoiseImage(const Film& film, const AOVBuffers& aovs, int iterations);
+
+#endif
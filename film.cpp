@@ -0,0 +1,113 @@
+#include "film.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Sample values saturate at +-2^18, so 2^21 samples at the limit still fit the 64-bit
+// sum; non-finite samples add nothing
+int64_t toFixed(float value) {
+    const double limit = 0x1p18;
+    if (!std::isfinite(value)) {
+        return 0;
+    }
+    return std::llround(std::ldexp(std::clamp(static_cast<double>(value), -limit, limit), FilmPixel::ColorFractionBits));
+}
+
+} // namespace
+
+Film::Film(int width, int height) : width(width), height(height), pixels(width * height) {}
+
+void Film::addSample(int x, int y, const Color& color) {
+    FilmPixel& pixel = pixels[y * width + x];
+    double luminance = 0.2126 * color.r + 0.7152 * color.g + 0.0722 * color.b;
+    pixel.colorSum[0] += toFixed(color.r);
+    pixel.colorSum[1] += toFixed(color.g);
+    pixel.colorSum[2] += toFixed(color.b);
+    pixel.samples += 1;
+    pixel.luminanceSum += luminance;
+    pixel.luminanceSquaredSum += luminance * luminance;
+}
+
+Color Film::getPixel(int x, int y) const {
+    const FilmPixel& pixel = pixels[y * width + x];
+    if (pixel.samples == 0) {
+        return Color();
+    }
+    double scale = std::ldexp(1.0, -FilmPixel::ColorFractionBits) / pixel.samples;
+    return Color(static_cast<float>(pixel.colorSum[0] * scale), static_cast<float>(pixel.colorSum[1] * scale),
+                 static_cast<float>(pixel.colorSum[2] * scale));
+}
+
+int Film::getSampleCount(int x, int y) const {
+    return pixels[y * width + x].samples;
+}
+
+long long Film::getTotalSamples() const {
+    long long total = 0;
+    for (const FilmPixel& pixel : pixels) {
+        total += pixel.samples;
+    }
+    return total;
+}
+
+float Film::getRelativeError(int x, int y) const {
+    const FilmPixel& pixel = pixels[y * width + x];
+    int n = pixel.samples;
+    if (n < 2) {
+        return std::numeric_limits<float>::infinity();
+    }
+
+    double mean = pixel.luminanceSum / n;
+    double variance = std::max(0.0, (pixel.luminanceSquaredSum - mean * pixel.luminanceSum) / (n - 1));
+    return static_cast<float>(std::sqrt(variance / n) / std::max(mean, 0.01));
+}
+
+// Black pixels are trivially converged and would dilute the average, so only pixels
+// that received light count
+float Film::getAverageRelativeError() const {
+    double total = 0.0;
+    int count = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if (pixels[y * width + x].luminanceSum > 0.0) {
+                total += getRelativeError(x, y);
+                ++count;
+            }
+        }
+    }
+    return count > 0 ? static_cast<float>(total / count) : 0.0f;
+}
+
+bool Film::isConverged(int x, int y, int minSamples, float errorThreshold) const {
+    return pixels[y * width + x].samples >= minSamples && getRelativeError(x, y) <= errorThreshold;
+}
+
+void Film::mergePixel(int x, int y, const FilmPixel& other) {
+    FilmPixel& pixel = pixels[y * width + x];
+    for (int c = 0; c < 3; ++c) {
+        pixel.colorSum[c] += other.colorSum[c];
+    }
+    pixel.samples += other.samples;
+    pixel.luminanceSum += other.luminanceSum;
+    pixel.luminanceSquaredSum += other.luminanceSquaredSum;
+}
+
+void Film::clear(const Tile& tile) {
+    for (int y = tile.y0; y < tile.y1; ++y) {
+        for (int x = tile.x0; x < tile.x1; ++x) {
+            pixels[y * width + x] = FilmPixel();
+        }
+    }
+}
+
+std::vector<Tile> Film::makeTiles(int tileSize) const {
+    std::vector<Tile> tiles;
+    for (int y = 0; y < height; y += tileSize) {
+        for (int x = 0; x < width; x += tileSize) {
+            tiles.push_back({x, y, std::min(x + tileSize, width), std::min(y + tileSize, height)});
+        }
+    }
+    return tiles;
+}
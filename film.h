@@ -0,0 +1,59 @@
+#ifndef FILM_H
+#define FILM_H
+
+#include "color.h"
+#include <cstdint>
+#include <vector>
+
+// Rectangle of pixels [x0, x1) x [y0, y1)
+struct Tile {
+    int x0, y0, x1, y1;
+};
+
+// Accumulated samples of one pixel. Luminance moments drive adaptive sampling and
+// survive merging partial renders of the same pixel.
+//
+// The color sum is fixed point with ColorFractionBits fractional bits. Integer
+// addition is associative, so the sum has the same bits whatever order the samples
+// were added or merged in, e.g. when sample ranges of a pixel come from different
+// farm workers.
+struct FilmPixel {
+    static constexpr int ColorFractionBits = 24;
+    int64_t colorSum[3] = {};
+    int samples = 0;
+    double luminanceSum = 0.0;
+    double luminanceSquaredSum = 0.0;
+};
+
+// Accumulation buffer of FilmPixels, converted to floating point colours when read
+class Film {
+public:
+    Film(int width, int height);
+
+    void addSample(int x, int y, const Color& color);
+    Color getPixel(int x, int y) const;
+    int getSampleCount(int x, int y) const;
+    long long getTotalSamples() const;
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // Standard error of the pixel's mean luminance relative to the mean; infinite
+    // below two samples
+    float getRelativeError(int x, int y) const;
+    float getAverageRelativeError() const;
+    bool isConverged(int x, int y, int minSamples, float errorThreshold) const;
+
+    // Raw pixel access for merging films rendered elsewhere
+    const FilmPixel& getPixelData(int x, int y) const { return pixels[y * width + x]; }
+    void mergePixel(int x, int y, const FilmPixel& pixel);
+    void clear(const Tile& tile);
+
+    // Split the image into tiles in scanline order
+    std::vector<Tile> makeTiles(int tileSize) const;
+
+private:
+    int width, height;
+    std::vector<FilmPixel> pixels;
+};
+
+#endif
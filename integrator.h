@@ -0,0 +1,53 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "scene.h"
+#include "sampler.h"
+#include "color.h"
+#include "ray.h"
+#include <string>
+#include <tuple>
+
+// Integrators turn a camera ray into radiance. Each render mode is its own type so the
+// pixel loop is instantiated, and the integrator inlined, once per mode.
+struct BinaryIntegrator {
+    static constexpr const char* name = "binary";
+    static constexpr int defaultSamplesPerPixel = 1;
+
+    Color Li(const Scene& scene, const Ray& ray, Sampler&) const {
+        return scene.traceRay(ray) ? Color(1, 0, 0) : Color(0, 0, 0);
+    }
+};
+
+struct PhongIntegrator {
+    static constexpr const char* name = "phong";
+    static constexpr int defaultSamplesPerPixel = 1;
+
+    Color Li(const Scene& scene, const Ray& ray, Sampler&) const {
+        return scene.traceRayWithShading(ray);
+    }
+};
+
+struct PathTracerIntegrator {
+    static constexpr const char* name = "pathtracer";
+    static constexpr int defaultSamplesPerPixel = 100;
+    static constexpr int maxDepth = 5;
+
+    Color Li(const Scene& scene, const Ray& ray, Sampler& sampler) const {
+        return scene.traceRayWithBRDF(ray, sampler, maxDepth);
+    }
+};
+
+// Registered render modes. A new mode only needs an integrator type added here.
+using Integrators = std::tuple<BinaryIntegrator, PhongIntegrator, PathTracerIntegrator>;
+
+// Call function(integrator) with the integrator registered under `name`.
+// Returns false when no integrator has that name.
+template <typename Function>
+bool dispatchIntegrator(const std::string& name, Function&& function) {
+    return std::apply([&](auto... integrators) {
+        return ((name == decltype(integrators)::name ? (function(integrators), true) : false) || ...);
+    }, Integrators{});
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include "vector3.h"
+#include "color.h"
+#include "ray.h"
+#include "boundingbox.h"
+#include <algorithm>
+#include <cmath>
+
+struct Light {
+    Vector3 position;
+    float intensity;
+    Color color;
+    bool areaLight;
+    Vector3 normal;
+    float width, height;
+    Vector3 u, v; // Unit vectors spanning an area light
+
+    // Total emitted power, used to pick bright lights more often.
+    // Area lights emit radiance color * intensity from both faces.
+    float power() const {
+        float luminance = 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+        if (areaLight) {
+            return 2.0f * static_cast<float>(M_PI) * width * height * intensity * luminance;
+        }
+        return 4.0f * static_cast<float>(M_PI) * intensity * luminance;
+    }
+
+    BoundingBox getBoundingBox() const {
+        if (!areaLight) {
+            return BoundingBox(position, position);
+        }
+        Vector3 halfU = u * (width / 2);
+        Vector3 halfV = v * (height / 2);
+        Vector3 extent(std::abs(halfU.x) + std::abs(halfV.x),
+                       std::abs(halfU.y) + std::abs(halfV.y),
+                       std::abs(halfU.z) + std::abs(halfV.z));
+        return BoundingBox(position - extent, position + extent);
+    }
+
+    // Ray-rectangle intersection for area lights, ignoring hits at or before ray.tMin
+    float getIntersectionDistance(const Ray& ray) const {
+        if (!areaLight) return -1.0f;
+
+        float denom = normal.dot(ray.direction);
+        if (std::abs(denom) < 1e-8f) return -1.0f;
+
+        float t = normal.dot(position - ray.origin) / denom;
+        if (t <= ray.tMin) return -1.0f;
+
+        Vector3 local = ray.origin + ray.direction * t - position;
+        if (std::abs(local.dot(u)) <= width / 2 && std::abs(local.dot(v)) <= height / 2) {
+            return t;
+        }
+        return -1.0f;
+    }
+};
+
+#endif
@@ -0,0 +1,233 @@
+#include "lightsampler.h"
+#include <algorithm>
+#include <stdexcept>
+
+bool UniformLightSampler::sample(const Vector3&, float u, size_t& lightIndex, float& pmf) const {
+    if (lightCount == 0) return false;
+
+    lightIndex = std::min(static_cast<size_t>(u * lightCount), lightCount - 1);
+    pmf = 1.0f / lightCount;
+    return true;
+}
+
+float UniformLightSampler::pmf(const Vector3&, size_t) const {
+    return lightCount > 0 ? 1.0f / lightCount : 0.0f;
+}
+
+// Build the alias table with Vose's method
+PowerLightSampler::PowerLightSampler(const std::vector<Light>& lights)
+    : bins(lights.size()), lightPmf(lights.size()) {
+    if (lights.empty()) return;
+
+    double totalPower = 0.0;
+    for (const auto& light : lights) {
+        totalPower += std::max(0.0f, light.power());
+    }
+
+    size_t count = lights.size();
+    std::vector<double> scaled(count);
+    for (size_t i = 0; i < count; ++i) {
+        // Without any emitted power fall back to uniform selection
+        lightPmf[i] = totalPower > 0.0 ? static_cast<float>(std::max(0.0f, lights[i].power()) / totalPower) : 1.0f / count;
+        scaled[i] = static_cast<double>(lightPmf[i]) * count;
+    }
+
+    std::vector<uint32_t> small, large;
+    for (size_t i = 0; i < count; ++i) {
+        (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+    }
+
+    while (!small.empty() && !large.empty()) {
+        uint32_t less = small.back();
+        small.pop_back();
+        uint32_t more = large.back();
+        large.pop_back();
+
+        bins[less] = {static_cast<float>(scaled[less]), more};
+        scaled[more] -= 1.0 - scaled[less];
+        (scaled[more] < 1.0 ? small : large).push_back(more);
+    }
+
+    // Leftovers are full bins up to rounding error
+    for (uint32_t i : small) bins[i] = {1.0f, i};
+    for (uint32_t i : large) bins[i] = {1.0f, i};
+}
+
+bool PowerLightSampler::sample(const Vector3&, float u, size_t& lightIndex, float& pmf) const {
+    if (bins.empty()) return false;
+
+    float scaled = u * bins.size();
+    size_t bin = std::min(static_cast<size_t>(scaled), bins.size() - 1);
+    float remainder = scaled - bin;
+
+    lightIndex = remainder < bins[bin].probability ? bin : bins[bin].alias;
+    pmf = lightPmf[lightIndex];
+    return true;
+}
+
+float PowerLightSampler::pmf(const Vector3&, size_t lightIndex) const {
+    return lightPmf[lightIndex];
+}
+
+LightBVH::LightBVH(const std::vector<Light>& lights) : lights(lights.data()), lightPaths(lights.size()) {
+    if (lights.empty()) return;
+
+    std::vector<uint32_t> indices(lights.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        indices[i] = static_cast<uint32_t>(i);
+    }
+    nodes.reserve(2 * lights.size() - 1);
+    build(indices, 0, indices.size(), 0, 0);
+}
+
+// Median split along the largest extent of the light centers, nodes stored depth first
+int LightBVH::build(std::vector<uint32_t>& indices, size_t begin, size_t end, uint64_t path, int depth) {
+    int nodeIndex = static_cast<int>(nodes.size());
+    nodes.push_back(Node());
+
+    if (end - begin == 1) {
+        const Light& light = lights[indices[begin]];
+        nodes[nodeIndex] = {light.getBoundingBox(), std::max(0.0f, light.power()), -1, static_cast<int>(indices[begin])};
+        lightPaths[indices[begin]] = path;
+        return nodeIndex;
+    }
+
+    BoundingBox centerBox(lights[indices[begin]].position, lights[indices[begin]].position);
+    for (size_t i = begin; i < end; ++i) {
+        centerBox = BoundingBox::merge(centerBox, BoundingBox(lights[indices[i]].position, lights[indices[i]].position));
+    }
+
+    Vector3 extents = centerBox.max - centerBox.min;
+    int axis = 0;
+    if (extents.y > extents.x) axis = 1;
+    if (extents.z > (axis == 0 ? extents.x : extents.y)) axis = 2;
+
+    auto coordinate = [axis](const Vector3& v) {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    };
+
+    size_t mid = (begin + end) / 2;
+    std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end,
+                     [&](uint32_t a, uint32_t b) {
+                         return coordinate(lights[a].position) < coordinate(lights[b].position);
+                     });
+
+    build(indices, begin, mid, path, depth + 1);
+    int secondChild = build(indices, mid, end, path | (uint64_t(1) << depth), depth + 1);
+
+    const Node& left = nodes[nodeIndex + 1];
+    const Node& right = nodes[secondChild];
+    nodes[nodeIndex] = {BoundingBox::merge(left.bbox, right.bbox), left.power + right.power, secondChild, -1};
+    return nodeIndex;
+}
+
+// Estimated contribution of a node's lights at the point: power over squared distance,
+// with the distance clamped to the node size so points inside a cluster stay finite
+float LightBVH::importance(const Node& node, const Vector3& point) const {
+    if (node.power <= 0.0f) return 0.0f;
+
+    Vector3 center = (node.bbox.min + node.bbox.max) * 0.5f;
+    Vector3 diagonal = node.bbox.max - node.bbox.min;
+    Vector3 offset = point - center;
+    float distanceSquared = std::max(offset.dot(offset), diagonal.dot(diagonal) * 0.25f);
+    return node.power / std::max(distanceSquared, 1e-8f);
+}
+
+float LightBVH::leftProbability(const Node& node, const Vector3& point) const {
+    float left = importance(nodes[&node - nodes.data() + 1], point);
+    float right = importance(nodes[node.secondChild], point);
+    if (left + right <= 0.0f) return 0.5f;
+    return left / (left + right);
+}
+
+bool LightBVH::sample(const Vector3& point, float u, size_t& lightIndex, float& pmf) const {
+    if (nodes.empty()) return false;
+
+    size_t nodeIndex = 0;
+    pmf = 1.0f;
+
+    while (nodes[nodeIndex].lightIndex < 0) {
+        const Node& node = nodes[nodeIndex];
+        float pLeft = leftProbability(node, point);
+
+        // Reuse the sample for the next level by rescaling it
+        if (u < pLeft) {
+            u = std::min(u / pLeft, 0x1.fffffep-1f);
+            pmf *= pLeft;
+            nodeIndex = nodeIndex + 1;
+        } else {
+            u = std::min((u - pLeft) / (1.0f - pLeft), 0x1.fffffep-1f);
+            pmf *= 1.0f - pLeft;
+            nodeIndex = node.secondChild;
+        }
+    }
+
+    lightIndex = static_cast<size_t>(nodes[nodeIndex].lightIndex);
+    return pmf > 0.0f;
+}
+
+float LightBVH::pmf(const Vector3& point, size_t lightIndex) const {
+    if (nodes.empty()) return 0.0f;
+
+    uint64_t path = lightPaths[lightIndex];
+    size_t nodeIndex = 0;
+    float pmf = 1.0f;
+
+    while (nodes[nodeIndex].lightIndex < 0) {
+        const Node& node = nodes[nodeIndex];
+        float pLeft = leftProbability(node, point);
+        if (path & 1) {
+            pmf *= 1.0f - pLeft;
+            nodeIndex = node.secondChild;
+        } else {
+            pmf *= pLeft;
+            nodeIndex = nodeIndex + 1;
+        }
+        path >>= 1;
+    }
+
+    return pmf;
+}
+
+// Closest area light along the ray
+bool LightBVH::intersect(const Ray& ray, float maxDistance, size_t& lightIndex, float& distance) const {
+    if (nodes.empty()) return false;
+
+    bool hit = false;
+    distance = maxDistance;
+
+    int stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const Node& node = nodes[stack[--stackSize]];
+        if (!node.bbox.doesIntersect(ray)) continue;
+
+        if (node.lightIndex >= 0) {
+            float t = lights[node.lightIndex].getIntersectionDistance(ray);
+            if (t > 0 && t < distance) {
+                distance = t;
+                lightIndex = static_cast<size_t>(node.lightIndex);
+                hit = true;
+            }
+        } else {
+            stack[stackSize++] = node.secondChild;
+            stack[stackSize++] = static_cast<int>(&node - nodes.data()) + 1;
+        }
+    }
+
+    return hit;
+}
+
+std::shared_ptr<const LightSampler> createLightSampler(const std::string& name, const std::vector<Light>& lights,
+                                                       const std::shared_ptr<const LightBVH>& lightBVH) {
+    if (name == "uniform") {
+        return std::make_shared<UniformLightSampler>(lights.size());
+    } else if (name == "power") {
+        return std::make_shared<PowerLightSampler>(lights);
+    } else if (name == "bvh") {
+        return lightBVH;
+    }
+    throw std::runtime_error("Unknown light sampler: " + name);
+}
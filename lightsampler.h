@@ -0,0 +1,86 @@
+#ifndef LIGHTSAMPLER_H
+#define LIGHTSAMPLER_H
+
+#include "light.h"
+#include "boundingbox.h"
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+// Chooses which light a shading point samples
+class LightSampler {
+public:
+    virtual ~LightSampler() = default;
+
+    // Pick a light from a uniform sample in [0, 1); fails only without lights
+    virtual bool sample(const Vector3& point, float u, size_t& lightIndex, float& pmf) const = 0;
+    // Probability that sample() picks the light at the given point
+    virtual float pmf(const Vector3& point, size_t lightIndex) const = 0;
+};
+
+// Every light equally likely
+class UniformLightSampler : public LightSampler {
+public:
+    explicit UniformLightSampler(size_t lightCount) : lightCount(lightCount) {}
+
+    bool sample(const Vector3& point, float u, size_t& lightIndex, float& pmf) const override;
+    float pmf(const Vector3& point, size_t lightIndex) const override;
+
+private:
+    size_t lightCount;
+};
+
+// Lights picked in proportion to their emitted power through an alias table: O(1) per sample
+class PowerLightSampler : public LightSampler {
+public:
+    explicit PowerLightSampler(const std::vector<Light>& lights);
+
+    bool sample(const Vector3& point, float u, size_t& lightIndex, float& pmf) const override;
+    float pmf(const Vector3& point, size_t lightIndex) const override;
+
+private:
+    struct AliasBin {
+        float probability; // Chance of keeping this bin's own light
+        uint32_t alias;    // Light used otherwise
+    };
+
+    std::vector<AliasBin> bins;
+    std::vector<float> lightPmf;
+};
+
+// Bounding volume hierarchy over the lights. Sampling descends the tree choosing the child
+// with the larger estimated contribution at the shading point (power over squared distance),
+// so nearby bright lights are preferred in scenes with many emitters. The same tree
+// accelerates finding the area light hit by a ray.
+class LightBVH : public LightSampler {
+public:
+    explicit LightBVH(const std::vector<Light>& lights);
+
+    bool sample(const Vector3& point, float u, size_t& lightIndex, float& pmf) const override;
+    float pmf(const Vector3& point, size_t lightIndex) const override;
+    bool intersect(const Ray& ray, float maxDistance, size_t& lightIndex, float& distance) const;
+
+private:
+    struct Node {
+        BoundingBox bbox;
+        float power;
+        int secondChild; // Interior nodes: index of the right child, the left one follows the node
+        int lightIndex;  // Leaves: the light, -1 for interior nodes
+    };
+
+    const Light* lights; // The vector the tree was built over; rebuild the tree if it changes
+    std::vector<Node> nodes;
+    std::vector<uint64_t> lightPaths; // Child choices from the root to each light's leaf, one bit per level
+
+    int build(std::vector<uint32_t>& indices, size_t begin, size_t end, uint64_t path, int depth);
+    float importance(const Node& node, const Vector3& point) const;
+    float leftProbability(const Node& node, const Vector3& point) const;
+};
+
+// Create a light sampler by name: "uniform", "power" or "bvh". The "bvh" sampler is
+// lightBVH itself, which must have been built over the same lights.
+std::shared_ptr<const LightSampler> createLightSampler(const std::string& name, const std::vector<Light>& lights,
+                                                       const std::shared_ptr<const LightBVH>& lightBVH);
+
+#endif
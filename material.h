@@ -0,0 +1,34 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include "color.h"
+#include "texture.h"
+#include <cstdint>
+
+// Index into the scene's material table
+using MaterialId = uint32_t;
+
+struct Material {
+    Color color;
+    float reflectivity;
+    float transparency;
+    float refractiveIndex;
+    Texture* texture;
+
+    Material(const Color &color = Color(), float reflectivity = 0.0f, float transparency = 0.0f,
+             float refractiveIndex = 1.0f, Texture* texture = nullptr)
+        : color(color), reflectivity(reflectivity), transparency(transparency),
+          refractiveIndex(refractiveIndex), texture(texture) {}
+
+    // Surface color at the given texture coordinates
+    Color getColor(float u, float v) const {
+        return texture ? texture->getColorAt(u, v) : color;
+    }
+
+    // Surface color filtered over a footprint given by the texture coordinate derivatives
+    Color getColor(float u, float v, float dudx, float dvdx, float dudy, float dvdy) const {
+        return texture ? texture->getColorAt(u, v, dudx, dvdx, dudy, dvdy) : color;
+    }
+};
+
+#endif
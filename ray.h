@@ -1,8 +1,10 @@
-
 #ifndef RAY_H
 #define RAY_H
 
 #include "vector3.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 
 class Ray {
 public:
@@ -11,6 +13,35 @@ public:
 
     Vector3 origin;
     Vector3 direction;
+    float tMin = 0.0f;              // Hits at or before this distance are ignored
+    const void *excluded = nullptr; // Primitive object the ray cannot hit, e.g. the flat surface it leaves
+
+    // Ray differentials: auxiliary rays one pixel over in x and y, whose spread at a
+    // hit point gives the footprint for texture filtering
+    bool hasDifferentials = false;
+    Vector3 dxOrigin, dxDirection;
+    Vector3 dyOrigin, dyDirection;
 };
 
+// Bound on the rounding error of a hit point found at `distance` along a ray from
+// `origin`: a few ulps of the largest magnitude involved in computing it
+inline float hitPointError(const Vector3 &origin, const Vector3 &point, float distance) {
+    auto largest = [](const Vector3 &v) { return std::max({std::abs(v.x), std::abs(v.y), std::abs(v.z)}); };
+    return 32.0f * FLT_EPSILON * (largest(origin) + largest(point) + distance);
+}
+
+// Origin for a ray leaving a surface point: pushed along the normal, to the side the
+// direction points to, just past the point's error bound, then rounded away from the
+// surface so the new origin can never fall back onto it
+inline Vector3 offsetRayOrigin(const Vector3 &point, float error, const Vector3 &normal, const Vector3 &direction) {
+    float distance = error * (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+    Vector3 offset = normal * (direction.dot(normal) < 0.0f ? -distance : distance);
+    Vector3 origin = point + offset;
+
+    auto roundAway = [](float value, float away) {
+        return away > 0.0f ? std::nextafter(value, FLT_MAX) : away < 0.0f ? std::nextafter(value, -FLT_MAX) : value;
+    };
+    return Vector3(roundAway(origin.x, offset.x), roundAway(origin.y, offset.y), roundAway(origin.z, offset.z));
+}
+
 #endif
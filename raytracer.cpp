@@ -1,34 +1,350 @@
-
 #include "scene.h"
+#include "rendersettings.h"
+#include "integrator.h"
+#include "renderfarm.h"
+#include "renderdaemon.h"
+#include "renderprofile.h"
+#include "stats.h"
+#include "texturecache.h"
+#include <algorithm>
 #include <iostream>
+#include <iomanip>
+#include <limits>
+#include <cstdio>
+#include <future>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
+
+// Output name of a sequence frame: the frame number inserted before the extension,
+// e.g. output.ppm -> output_0007.ppm
+std::string frameFilename(const std::string& pattern, int frame) {
+    char number[32];
+    std::snprintf(number, sizeof(number), "_%04d", frame);
+    size_t dot = pattern.rfind('.');
+    if (dot == std::string::npos || pattern.find('/', dot) != std::string::npos) {
+        return pattern + number;
+    }
+    return pattern.substr(0, dot) + number + pattern.substr(dot);
+}
+
+const int MaxDaemonThreads = 1024;
+
+// Parses a whole number in [minimum, maximum]; false when the text is anything else
+bool parseInt(const std::string& text, int minimum, int maximum, int& value) {
+    size_t end = 0;
+    int parsed;
+    try {
+        parsed = std::stoi(text, &end);
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (end != text.size() || parsed < minimum || parsed > maximum) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+void printUsage() {
+    std::cerr << "Usage: ./raytracer <render_mode> (binary, phong or pathtracer) <json_file_name> [options]\n"
+              << "       ./raytracer --worker-listen <port> [address]  Serve render farm work over TCP on address\n"
+              << "                                                     (default: 127.0.0.1, 0.0.0.0 for all interfaces)\n"
+              << "       ./raytracer --daemon <socket> [threads]  Serve render jobs, keeping scenes loaded\n"
+              << "       ./raytracer --daemon-client <socket> <json>  Send a request to a render daemon\n"
+              << "Options:\n"
+              << "  --sampler <random|halton|sobol>      Sample generator (default: sobol)\n"
+              << "  --seed <n>                           Sample seed; equal seeds give identical images (default: 0)\n"
+              << "  --light-sampler <uniform|power|bvh>  Light selection (default: power)\n"
+              << "  --spp <n>                            Samples per pixel (default: 1, 100 for pathtracer)\n"
+              << "  --adaptive                           Stop sampling pixels once they converge\n"
+              << "  --min-spp <n>                        Adaptive minimum samples per pixel (default: 16)\n"
+              << "  --max-spp <n>                        Adaptive maximum samples per pixel (default: --spp)\n"
+              << "  --threshold <e>                      Adaptive relative error target (default: 0.02)\n"
+              << "  --heatmap <file>                     Write a samples-per-pixel heatmap\n"
+              << "  --denoise                            Filter the image guided by first-hit albedo, normal and depth\n"
+              << "  --denoise-iterations <n>             Denoiser passes, each doubling its reach, 1 to 10 (default: 5)\n"
+              << "  --aov <prefix>                       Write <prefix>_albedo.ppm, _normal.ppm and _depth.ppm\n"
+              << "  --output <file>                      Image path (default: output.ppm)\n"
+              << "  --sequence                           Render every camera of the scene's cameras/camera_path\n"
+              << "                                       to numbered outputs\n"
+              << "  --progressive                        Render doubling passes, updating the image after each\n"
+              << "  --time-budget <s>                    Progressive: stop after this many seconds\n"
+              << "  --noise-target <e>                   Progressive: stop at this average relative error\n"
+              << "  --checkpoint <file>                  Periodically save progress to file\n"
+              << "  --checkpoint-interval <s>            Seconds between checkpoints (default: 60)\n"
+              << "  --resume                             Continue from the --checkpoint file\n"
+              << "  --stats                              Print ray counts and phase timings\n"
+              << "  --stats-json <file>                  Write the statistics as JSON\n"
+              << "  --farm <n>                           Render on n forked local worker processes\n"
+              << "  --farm-connect <host:port>           Also render on a remote worker (repeatable)\n"
+              << "  --farm-split <tiles|samples>         Split the frame by tiles or sample ranges (default: tiles)\n"
+              << "  --cost-map <file>                    Write a false-colour map of the render cost per pixel\n"
+              << "  --cost-metric <time|rays|nodes>      Cost shown by the map (default: time)\n"
+              << "  --cost-per-pixel                     Measure the cost of every pixel instead of every tile\n"
+              << "  --trace <file>                       Write each thread's tile timeline as Chrome trace JSON\n"
+              << "  --texture-format <name>              Texel storage: float, fp16, rgba8, rgb8 or bc1 (default: float)\n"
+              << "  --texture-cache <MB>                 Stream textures from tiled files, keeping at most MB resident\n";
+}
 
 int main(int argc, char** argv) {
+    if ((argc == 3 || argc == 4) && std::string(argv[1]) == "--worker-listen") {
+        int port;
+        if (!parseInt(argv[2], 1, 65535, port)) {
+            std::cerr << "--worker-listen needs a port from 1 to 65535\n";
+            printUsage();
+            return 1;
+        }
+        listenForRenderJobs(port, argc == 4 ? argv[3] : "127.0.0.1");
+        return 0;
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--daemon") {
+        // hardware_concurrency() is 0 when the core count is unknown
+        int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        if (argc > 3 && !parseInt(argv[3], 1, MaxDaemonThreads, threads)) {
+            std::cerr << "--daemon needs a thread count from 1 to " << MaxDaemonThreads << "\n";
+            printUsage();
+            return 1;
+        }
+        RenderDaemon daemon(argv[2], static_cast<unsigned>(threads));
+        daemon.run();
+        return 0;
+    }
+    if (argc == 4 && std::string(argv[1]) == "--daemon-client") {
+        return runDaemonClient(argv[2], argv[3]);
+    }
+
     if (argc < 3) {
-        std::cerr << "Usage: ./raytracer <render_mode> (binary, phong or pathtracer) <json_file_name>\n";
+        printUsage();
         return 1;
     }
 
-    std::string renderMode = argv[1];
+    RenderSettings settings;
+    settings.renderMode = argv[1];
     std::string filename = argv[2];
+    std::string outputFile = "output.ppm";
+    bool sequence = false;
+    bool printStats = false;
+    std::string statsFile;
 
-    if (renderMode != "binary" && renderMode != "phong" && renderMode != "pathtracer") {
+    bool validMode = dispatchIntegrator(settings.renderMode, [&](const auto& integrator) {
+        settings.samplesPerPixel = std::decay_t<decltype(integrator)>::defaultSamplesPerPixel;
+    });
+    if (!validMode) {
         std::cerr << "Invalid render mode. Use 'binary', 'phong' or 'pathtracer'.\n";
         return 1;
     }
 
+    for (int i = 3; i < argc; ++i) {
+        std::string option = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (option == "--sampler" && hasValue) {
+            settings.samplerName = argv[++i];
+        } else if (option == "--seed" && hasValue) {
+            settings.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (option == "--light-sampler" && hasValue) {
+            settings.lightSamplerName = argv[++i];
+        } else if (option == "--spp" && hasValue) {
+            if (!parseInt(argv[++i], 1, std::numeric_limits<int>::max(), settings.samplesPerPixel)) {
+                std::cerr << "--spp needs a whole number of at least 1\n";
+                return 1;
+            }
+        } else if (option == "--adaptive") {
+            settings.adaptive = true;
+        } else if (option == "--min-spp" && hasValue) {
+            if (!parseInt(argv[++i], 1, std::numeric_limits<int>::max(), settings.minSamplesPerPixel)) {
+                std::cerr << "--min-spp needs a whole number of at least 1\n";
+                return 1;
+            }
+        } else if (option == "--max-spp" && hasValue) {
+            if (!parseInt(argv[++i], 1, std::numeric_limits<int>::max(), settings.maxSamplesPerPixel)) {
+                std::cerr << "--max-spp needs a whole number of at least 1\n";
+                return 1;
+            }
+        } else if (option == "--threshold" && hasValue) {
+            settings.errorThreshold = std::stof(argv[++i]);
+        } else if (option == "--heatmap" && hasValue) {
+            settings.heatmapFile = argv[++i];
+        } else if (option == "--denoise") {
+            settings.denoise = true;
+        } else if (option == "--denoise-iterations" && hasValue) {
+            if (!parseInt(argv[++i], 1, RenderSettings::MaxDenoiseIterations, settings.denoiseIterations)) {
+                std::cerr << "--denoise-iterations needs a whole number from 1 to " << RenderSettings::MaxDenoiseIterations << "\n";
+                return 1;
+            }
+        } else if (option == "--aov" && hasValue) {
+            settings.aovPrefix = argv[++i];
+        } else if (option == "--output" && hasValue) {
+            outputFile = argv[++i];
+        } else if (option == "--sequence") {
+            sequence = true;
+        } else if (option == "--progressive") {
+            settings.progressive = true;
+        } else if (option == "--time-budget" && hasValue) {
+            settings.progressive = true;
+            settings.timeBudget = std::stof(argv[++i]);
+        } else if (option == "--noise-target" && hasValue) {
+            settings.progressive = true;
+            settings.noiseTarget = std::stof(argv[++i]);
+        } else if (option == "--checkpoint" && hasValue) {
+            settings.checkpointFile = argv[++i];
+        } else if (option == "--checkpoint-interval" && hasValue) {
+            settings.checkpointInterval = std::stof(argv[++i]);
+        } else if (option == "--resume") {
+            settings.resume = true;
+        } else if (option == "--stats") {
+            printStats = true;
+        } else if (option == "--stats-json" && hasValue) {
+            statsFile = argv[++i];
+        } else if (option == "--farm" && hasValue) {
+            if (!parseInt(argv[++i], 0, RenderSettings::MaxFarmWorkers, settings.farmWorkers)) {
+                std::cerr << "--farm needs a worker count from 0 to " << RenderSettings::MaxFarmWorkers << "\n";
+                printUsage();
+                return 1;
+            }
+        } else if (option == "--farm-connect" && hasValue) {
+            settings.farmHosts.push_back(argv[++i]);
+        } else if (option == "--farm-split" && hasValue) {
+            settings.farmSplit = argv[++i];
+        } else if (option == "--cost-map" && hasValue) {
+            settings.costMapFile = argv[++i];
+        } else if (option == "--cost-metric" && hasValue) {
+            settings.costMetric = argv[++i];
+        } else if (option == "--cost-per-pixel") {
+            settings.costPerPixel = true;
+        } else if (option == "--trace" && hasValue) {
+            settings.traceFile = argv[++i];
+        } else if (option == "--texture-format" && hasValue) {
+            settings.textureFormat = argv[++i];
+        } else if (option == "--texture-cache" && hasValue) {
+            TextureCache::global().setBudget(static_cast<size_t>(std::stod(argv[++i]) * 1024.0 * 1024.0));
+        } else {
+            std::cerr << "Unknown option: " << option << "\n";
+            return 1;
+        }
+    }
+
+    if (settings.resume && settings.checkpointFile.empty()) {
+        std::cerr << "--resume needs --checkpoint <file>\n";
+        return 1;
+    }
+    if (settings.maxSamplesPerPixel > 0 && settings.minSamplesPerPixel > settings.maxSamplesPerPixel) {
+        std::cerr << "--min-spp cannot exceed --max-spp\n";
+        return 1;
+    }
+    bool farm = settings.farmWorkers > 0 || !settings.farmHosts.empty();
+    if (farm && (!settings.checkpointFile.empty() || settings.progressive)) {
+        std::cerr << "Checkpoints and progressive rendering are not supported with --farm\n";
+        return 1;
+    }
+    bool profiling = !settings.costMapFile.empty() || !settings.traceFile.empty();
+    if (sequence && (farm || !settings.checkpointFile.empty() || settings.progressive || profiling)) {
+        std::cerr << "--sequence cannot be combined with --farm, checkpoints, progressive rendering or cost capture\n";
+        return 1;
+    }
+    if (farm && settings.costPerPixel) {
+        std::cerr << "--cost-per-pixel is not supported with --farm\n";
+        return 1;
+    }
+
     Scene scene;
-    scene.loadFromJson(filename);
+    scene.setTextureFormat(parseTextureFormat(settings.textureFormat));
+    {
+        STATS_PHASE(Parse);
+        scene.loadFromJson(filename);
+    }
     scene.buildBVH();
+    scene.finishLoading();
+    scene.setLightSampler(settings.lightSamplerName);
 
-    int samplesPerPixel = 1;
-    if (renderMode == "pathtracer") {
-        samplesPerPixel = 100;
-    }
+    std::unique_ptr<Sampler> sampler = createSampler(settings.samplerName, settings.maxSamples(), settings.seed);
 
     Camera* camera = scene.getCamera();
-    if (camera) {
-        camera->renderScene(scene, "output.ppm", renderMode, samplesPerPixel);
+    if (!camera) {
+        return 0;
+    }
+
+    std::unique_ptr<RenderProfile> profile;
+    if (profiling) {
+        profile = std::make_unique<RenderProfile>(camera->getWidth(), camera->getHeight(), settings);
+    }
+
+    if (sequence) {
+        std::vector<Camera> frames = scene.getSequenceCameras();
+        if (frames.empty()) {
+            frames.push_back(*camera);
+        }
+
+        // Each frame's image is written on a separate thread while the next frame renders
+        std::future<void> pendingWrite;
+        for (size_t frame = 0; frame < frames.size(); ++frame) {
+            auto film = std::make_shared<Film>(frames[frame].getWidth(), frames[frame].getHeight());
+            frames[frame].renderFilm(scene, settings, *sampler, *film);
+            std::shared_ptr<AOVBuffers> aovs;
+            if (settings.needsAOVs()) {
+                aovs = std::make_shared<AOVBuffers>(frames[frame].renderAOVs(scene, settings, *sampler));
+            }
+
+            if (pendingWrite.valid()) {
+                pendingWrite.get();
+            }
+            std::string frameFile = frameFilename(outputFile, static_cast<int>(frame));
+            RenderSettings frameSettings = settings;
+            if (!settings.aovPrefix.empty()) {
+                frameSettings.aovPrefix = frameFilename(settings.aovPrefix, static_cast<int>(frame));
+            }
+            pendingWrite = std::async(std::launch::async, [&frames, frameSettings, frame, film, aovs, frameFile] {
+                frames[frame].writeOutputs(frameFile, *film, frameSettings, aovs.get());
+            });
+            std::cout << "Frame " << frame + 1 << "/" << frames.size() << ": " << frameFile << std::endl;
+        }
+        pendingWrite.get();
+    } else if (farm) {
+        RenderFarm farm(filename, settings);
+        farm.spawnLocalWorkers(settings.farmWorkers);
+        for (const std::string& host : settings.farmHosts) {
+            farm.connectWorker(host);
+        }
+
+        Film film(camera->getWidth(), camera->getHeight());
+        {
+            // Rays are traced and counted in the worker processes
+            STATS_PHASE(Render);
+            farm.render(film, profile.get());
+        }
+        // The AOV pass is cheap next to the render, so the coordinator traces it itself
+        if (settings.needsAOVs()) {
+            AOVBuffers aovs = camera->renderAOVs(scene, settings, *sampler);
+            camera->writeOutputs(outputFile, film, settings, &aovs);
+        } else {
+            camera->writeOutputs(outputFile, film, settings);
+        }
+    } else {
+        camera->renderScene(scene, outputFile, settings, *sampler, profile.get());
+    }
+
+    if (profile) {
+        profile->write();
+    }
+
+    // Farm workers sample textures in their own processes
+    const TextureCache& textureCache = TextureCache::global();
+    if (textureCache.enabled() && !farm) {
+        auto megabytes = [](size_t bytes) { return bytes / (1024.0 * 1024.0); };
+        std::cout << std::fixed << std::setprecision(1) << "Texture cache: " << megabytes(textureCache.getResidentBytes())
+                  << " MB resident, " << megabytes(textureCache.getPeakBytes()) << " MB peak, "
+                  << megabytes(textureCache.getBudget()) << " MB budget\n" << std::defaultfloat;
+    }
+
+    if (printStats || !statsFile.empty()) {
+        stats::Summary summary = stats::collect();
+        if (printStats) {
+            stats::printSummary(std::cout, summary);
+        }
+        if (!statsFile.empty()) {
+            stats::writeJson(statsFile, summary);
+        }
     }
 
     return 0;
@@ -0,0 +1,445 @@
+#include "renderdaemon.h"
+#include "camera.h"
+#include "film.h"
+#include "integrator.h"
+#include "renderprofile.h"
+#include "scene.h"
+#include "json.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using json = nlohmann::json;
+
+struct RenderDaemon::Job {
+    int id = 0;
+    std::string sceneFile;
+    std::string output;
+    RenderSettings settings;
+    std::shared_ptr<Scene> scene;
+    std::unique_ptr<Camera> camera;
+    std::unique_ptr<Film> film;
+    std::unique_ptr<RenderProfile> profile; // when a cost map or trace is requested
+    std::vector<Tile> tiles;
+    std::chrono::steady_clock::time_point start;
+
+    // Guarded by jobMutex
+    std::string state = "queued"; // queued, rendering, done or failed
+    std::string error;
+    size_t tilesDone = 0;
+    float seconds = 0.0f;
+    bool abandoned = false; // The client hung up before the job ended
+
+    json status() const {
+        json result = {{"job", id}, {"state", state}, {"scene", sceneFile}, {"output", output},
+                       {"progress", tiles.empty() ? 0.0 : static_cast<double>(tilesDone) / tiles.size()}};
+        if (state == "done") result["seconds"] = seconds;
+        if (state == "failed") result["error"] = error;
+        return result;
+    }
+};
+
+namespace {
+
+sockaddr_un socketAddress(const std::string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    std::strcpy(address.sun_path, path.c_str());
+    return address;
+}
+
+bool sendLine(int fd, const json& message) {
+    std::string line = message.dump() + "\n";
+    const char* data = line.data();
+    size_t size = line.size();
+    while (size > 0) {
+        ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool receiveLine(int fd, std::string& line) {
+    line.clear();
+    char c;
+    while (true) {
+        ssize_t received = ::read(fd, &c, 1);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return !line.empty();
+        if (c == '\n') return true;
+        line += c;
+        if (line.size() > (1u << 20)) return false;
+    }
+}
+
+Vector3 vectorOr(const json& object, const char* key, const Vector3& fallback) {
+    if (!object.contains(key)) return fallback;
+    const json& value = object.at(key);
+    return {value.at(0).get<float>(), value.at(1).get<float>(), value.at(2).get<float>()};
+}
+
+// Render settings of a request, starting from the defaults of the command line
+RenderSettings requestSettings(const json& request) {
+    RenderSettings settings;
+    settings.renderMode = request.value("mode", std::string("phong"));
+    bool validMode = dispatchIntegrator(settings.renderMode, [&](const auto& integrator) {
+        settings.samplesPerPixel = std::decay_t<decltype(integrator)>::defaultSamplesPerPixel;
+    });
+    if (!validMode) {
+        throw std::runtime_error("Unknown render mode: " + settings.renderMode);
+    }
+
+    settings.samplesPerPixel = request.value("spp", settings.samplesPerPixel);
+    settings.samplerName = request.value("sampler", settings.samplerName);
+    settings.seed = request.value("seed", settings.seed);
+    settings.lightSamplerName = request.value("light_sampler", settings.lightSamplerName);
+    settings.textureFormat = request.value("texture_format", settings.textureFormat);
+    settings.tileSize = std::max(1, request.value("tile_size", settings.tileSize));
+    settings.adaptive = request.value("adaptive", settings.adaptive);
+    settings.minSamplesPerPixel = request.value("min_spp", settings.minSamplesPerPixel);
+    settings.maxSamplesPerPixel = request.value("max_spp", settings.maxSamplesPerPixel);
+    settings.errorThreshold = request.value("threshold", settings.errorThreshold);
+    settings.costMapFile = request.value("cost_map", settings.costMapFile);
+    settings.costMetric = request.value("cost_metric", settings.costMetric);
+    settings.costPerPixel = request.value("cost_per_pixel", settings.costPerPixel);
+    settings.traceFile = request.value("trace", settings.traceFile);
+    if (settings.samplesPerPixel < 1 || settings.minSamplesPerPixel < 1 || settings.maxSamplesPerPixel < 0) {
+        throw std::runtime_error("Sample counts must be at least 1");
+    }
+    if (settings.maxSamplesPerPixel > 0 && settings.minSamplesPerPixel > settings.maxSamplesPerPixel) {
+        throw std::runtime_error("min_spp cannot exceed max_spp");
+    }
+    settings.denoise = request.value("denoise", settings.denoise);
+    settings.denoiseIterations = request.value("denoise_iterations", settings.denoiseIterations);
+    if (settings.denoiseIterations < 1 || settings.denoiseIterations > RenderSettings::MaxDenoiseIterations) {
+        throw std::runtime_error("denoise_iterations must be from 1 to " + std::to_string(RenderSettings::MaxDenoiseIterations));
+    }
+    settings.aovPrefix = request.value("aov", settings.aovPrefix);
+    return settings;
+}
+
+// The scene's camera with any of the scene file's camera keys replaced
+std::unique_ptr<Camera> requestCamera(const Camera& base, const json& request) {
+    if (!request.contains("camera")) {
+        return std::make_unique<Camera>(base);
+    }
+
+    const json& overrides = request.at("camera");
+    return std::make_unique<Camera>(vectorOr(overrides, "position", base.getPosition()),
+                                    vectorOr(overrides, "look_at", base.getDirection()),
+                                    vectorOr(overrides, "up", base.getUp()),
+                                    overrides.value("fov", base.getFov()),
+                                    overrides.value("width", base.getWidth()),
+                                    overrides.value("height", base.getHeight()),
+                                    overrides.value("aperture", base.getAperture()),
+                                    overrides.value("focus_distance", base.getFocusDistance()));
+}
+
+} // namespace
+
+RenderDaemon::RenderDaemon(const std::string& socketPath, unsigned threadCount)
+    : socketPath(socketPath), pool(threadCount) {}
+
+RenderDaemon::~RenderDaemon() {
+    if (listenFd >= 0) {
+        ::close(listenFd);
+        ::unlink(socketPath.c_str());
+    }
+}
+
+void RenderDaemon::run() {
+    std::signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un address = socketAddress(socketPath);
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        throw std::runtime_error("Failed to create socket: " + std::string(std::strerror(errno)));
+    }
+    ::unlink(socketPath.c_str());
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listenFd, 16) != 0) {
+        throw std::runtime_error("Failed to listen on " + socketPath + ": " + std::strerror(errno));
+    }
+
+    std::cout << "Render daemon listening on " << socketPath << " with " << pool.size() << " threads" << std::endl;
+    while (!stopping) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (stopping) break;
+            throw std::runtime_error("accept failed: " + std::string(std::strerror(errno)));
+        }
+
+        ++openConnections;
+        std::thread([this, fd] {
+            handleConnection(fd);
+            ::close(fd);
+            std::lock_guard<std::mutex> lock(jobMutex);
+            --openConnections;
+            jobChanged.notify_all();
+        }).detach();
+    }
+
+    // Connections stay open until their jobs finish
+    std::unique_lock<std::mutex> lock(jobMutex);
+    jobChanged.wait(lock, [this] { return openConnections == 0; });
+    std::cout << "Render daemon stopped" << std::endl;
+}
+
+void RenderDaemon::handleConnection(int fd) {
+    std::string line;
+    if (!receiveLine(fd, line)) return;
+
+    std::shared_ptr<Job> job;
+    try {
+        json request = json::parse(line);
+        std::string command = request.value("command", std::string("render"));
+
+        if (command == "status") {
+            json list = json::array();
+            std::lock_guard<std::mutex> lock(jobMutex);
+            for (const auto& entry : jobs) {
+                list.push_back(entry.second->status());
+            }
+            sendLine(fd, {{"jobs", list}});
+            return;
+        } else if (command == "shutdown") {
+            sendLine(fd, {{"state", "shutting down"}});
+            stopping = true;
+            ::shutdown(listenFd, SHUT_RDWR);
+            return;
+        } else if (command != "render") {
+            throw std::runtime_error("Unknown command: " + command);
+        }
+
+        job = std::make_shared<Job>();
+        job->sceneFile = request.at("scene").get<std::string>();
+        job->output = request.value("output", std::string("output.ppm"));
+        job->settings = requestSettings(request);
+        job->scene = getScene(job->sceneFile, job->settings);
+        if (!job->scene->getCamera()) {
+            throw std::runtime_error("Scene has no camera: " + job->sceneFile);
+        }
+        job->camera = requestCamera(*job->scene->getCamera(), request);
+        // Reject unknown samplers before any tile is queued
+        createSampler(job->settings.samplerName, 1);
+        job->film = std::make_unique<Film>(job->camera->getWidth(), job->camera->getHeight());
+        job->tiles = job->film->makeTiles(job->settings.tileSize);
+        if (!job->settings.costMapFile.empty() || !job->settings.traceFile.empty()) {
+            job->profile = std::make_unique<RenderProfile>(job->camera->getWidth(), job->camera->getHeight(),
+                                                           job->settings);
+        }
+    } catch (const std::exception& e) {
+        sendLine(fd, {{"error", e.what()}});
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        job->id = nextJobId++;
+        jobs[job->id] = job;
+    }
+    startJob(job);
+
+    // Progress is reported at most twice a second and whenever the job ends
+    std::unique_lock<std::mutex> lock(jobMutex);
+    size_t reported = static_cast<size_t>(-1);
+    while (true) {
+        bool ended = job->state == "done" || job->state == "failed";
+        if (ended || job->tilesDone != reported) {
+            reported = job->tilesDone;
+            json status = job->status();
+            lock.unlock();
+            bool connected = sendLine(fd, status);
+            lock.lock();
+            if (ended || !connected) break;
+        }
+        jobChanged.wait_for(lock, std::chrono::milliseconds(500));
+    }
+
+    // The result has reached the client, or nobody is left to collect it: a job that
+    // is still running is removed by completeJob instead
+    if (job->state == "done" || job->state == "failed") {
+        jobs.erase(job->id);
+    } else {
+        job->abandoned = true;
+    }
+}
+
+void RenderDaemon::startJob(const std::shared_ptr<Job>& job) {
+    job->start = std::chrono::steady_clock::now();
+
+    for (const Tile& tile : job->tiles) {
+        pool.submit([this, job, tile] {
+            bool skip;
+            {
+                std::lock_guard<std::mutex> lock(jobMutex);
+                skip = job->state == "failed";
+                if (!skip) job->state = "rendering";
+            }
+
+            std::string error;
+            if (!skip) {
+                try {
+                    // Samplers carry per-sample state, so every tile gets its own
+                    std::unique_ptr<Sampler> sampler =
+                        createSampler(job->settings.samplerName, job->settings.maxSamples(), job->settings.seed);
+                    job->camera->renderTile(*job->scene, job->settings, *sampler, tile, 0, job->settings.maxSamples(), *job->film,
+                                            job->profile.get());
+                } catch (const std::exception& e) {
+                    error = e.what();
+                }
+            }
+
+            if (finishTile(job, error)) {
+                completeJob(job);
+            }
+        });
+    }
+}
+
+// True for the thread that finished the last tile
+bool RenderDaemon::finishTile(const std::shared_ptr<Job>& job, const std::string& error) {
+    std::lock_guard<std::mutex> lock(jobMutex);
+    if (!error.empty() && job->state != "failed") {
+        job->state = "failed";
+        job->error = error;
+    }
+    ++job->tilesDone;
+    jobChanged.notify_all();
+    return job->tilesDone == job->tiles.size();
+}
+
+// Writes the image (denoised on request) outside the lock, then keeps only the job's status
+// until the client collects it
+void RenderDaemon::completeJob(const std::shared_ptr<Job>& job) {
+    std::string error;
+    bool failed;
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        failed = job->state == "failed";
+    }
+
+    if (!failed) {
+        try {
+            if (job->settings.needsAOVs()) {
+                std::unique_ptr<Sampler> sampler =
+                    createSampler(job->settings.samplerName, job->settings.maxSamples(), job->settings.seed);
+                AOVBuffers aovs = job->camera->renderAOVs(*job->scene, job->settings, *sampler);
+                job->camera->writeOutputs(job->output, *job->film, job->settings, &aovs);
+            } else {
+                job->camera->writeImage(job->output, *job->film);
+            }
+            if (job->profile) {
+                job->profile->write();
+            }
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(jobMutex);
+    if (!failed) {
+        job->state = error.empty() ? "done" : "failed";
+        job->error = error;
+    }
+    job->seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - job->start).count();
+    job->film.reset();
+    job->profile.reset();
+    job->camera.reset();
+    job->scene.reset();
+    if (job->abandoned) {
+        jobs.erase(job->id);
+    }
+    jobChanged.notify_all();
+}
+
+// Scenes are parsed once per light sampler and texture format and reloaded when the
+// file changes; jobs still rendering an older version keep it alive. Loads run outside
+// sceneMutex, so a slow scene only holds up the requests that need it: the first one
+// publishes a future for the load and later ones wait on that.
+std::shared_ptr<Scene> RenderDaemon::getScene(const std::string& filename, const RenderSettings& settings) {
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) {
+        throw std::runtime_error("Scene not found: " + filename);
+    }
+
+    std::string key = filename + "\n" + settings.lightSamplerName + "\n" + settings.textureFormat;
+    std::promise<std::shared_ptr<Scene>> load;
+    std::shared_future<std::shared_ptr<Scene>> published;
+    bool loading = false;
+    {
+        std::lock_guard<std::mutex> lock(sceneMutex);
+        auto it = scenes.find(key);
+        if (it != scenes.end() && it->second.modified == info.st_mtime) {
+            published = it->second.scene;
+        } else {
+            published = load.get_future().share();
+            scenes[key] = {published, info.st_mtime};
+            loading = true;
+        }
+    }
+    if (!loading) {
+        return published.get();
+    }
+
+    try {
+        auto scene = std::make_shared<Scene>();
+        scene->setTextureFormat(parseTextureFormat(settings.textureFormat));
+        scene->loadFromJson(filename);
+        scene->buildBVH();
+        scene->finishLoading();
+        scene->setLightSampler(settings.lightSamplerName);
+        load.set_value(scene);
+        std::cout << "Loaded " << filename << std::endl;
+    } catch (...) {
+        // Waiting requests see the error; the next one retries
+        load.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(sceneMutex);
+        auto it = scenes.find(key);
+        if (it != scenes.end() && it->second.modified == info.st_mtime) {
+            scenes.erase(it);
+        }
+    }
+    return published.get();
+}
+
+int runDaemonClient(const std::string& socketPath, const std::string& request) {
+    sockaddr_un address = socketAddress(socketPath);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "Failed to connect to " << socketPath << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    std::string line = request + "\n";
+    if (send(fd, line.data(), line.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(line.size())) {
+        std::cerr << "Failed to send request\n";
+        ::close(fd);
+        return 1;
+    }
+
+    bool failed = false;
+    while (receiveLine(fd, line)) {
+        std::cout << line << std::endl;
+        failed = json::parse(line, nullptr, false).contains("error");
+    }
+    ::close(fd);
+    return failed ? 1 : 0;
+}
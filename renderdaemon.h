@@ -0,0 +1,72 @@
+#ifndef RENDERDAEMON_H
+#define RENDERDAEMON_H
+
+#include "threadpool.h"
+#include "rendersettings.h"
+#include <atomic>
+#include <condition_variable>
+#include <ctime>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class Scene;
+
+// Long-running render server on a Unix domain socket. Parsed scenes with their
+// textures and BVHs stay resident between jobs (reloaded when the file changes),
+// and the tiles of all jobs share one thread pool.
+//
+// Each connection carries one JSON request line and receives JSON response lines:
+//   {"command": "render", "scene": "scene.json", "mode": "pathtracer", "spp": 64,
+//    "output": "out.ppm", "camera": {"position": [0, 1, 5], "fov": 60},
+//    "texture_format": "bc1", "denoise": true, "aov": "out", "cost_map": "cost.ppm",
+//    "trace": "trace.json", ...}
+//       streams {"job", "state", "progress"} lines until the job is done or failed
+//   {"command": "status"}    lists the jobs whose final status has not been delivered yet
+//   {"command": "shutdown"}  finishes the running jobs and exits
+class RenderDaemon {
+public:
+    RenderDaemon(const std::string& socketPath, unsigned threadCount);
+    ~RenderDaemon();
+
+    // Serve connections until a shutdown request arrives
+    void run();
+
+private:
+    struct CachedScene {
+        std::shared_future<std::shared_ptr<Scene>> scene; // Ready once loaded
+        time_t modified;
+    };
+
+    struct Job;
+
+    std::string socketPath;
+    int listenFd = -1;
+
+    std::mutex sceneMutex;
+    std::map<std::string, CachedScene> scenes; // keyed by path, light sampler and texture format
+
+    std::mutex jobMutex;
+    std::condition_variable jobChanged;
+    std::map<int, std::shared_ptr<Job>> jobs; // Removed once their final status is delivered
+    int nextJobId = 1;
+
+    std::atomic<bool> stopping{false};
+    std::atomic<int> openConnections{0};
+
+    // Declared last so its tasks finish before the state they use is destroyed
+    ThreadPool pool;
+
+    void handleConnection(int fd);
+    void startJob(const std::shared_ptr<Job>& job);
+    bool finishTile(const std::shared_ptr<Job>& job, const std::string& error);
+    void completeJob(const std::shared_ptr<Job>& job);
+    std::shared_ptr<Scene> getScene(const std::string& filename, const RenderSettings& settings);
+};
+
+// Send one request to a daemon and print its responses until it hangs up
+int runDaemonClient(const std::string& socketPath, const std::string& request);
+
+#endif
@@ -0,0 +1,488 @@
+#include "renderfarm.h"
+#include "camera.h"
+#include "scene.h"
+#include "renderprofile.h"
+#include "json.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+namespace {
+
+// Every message is a fixed header followed by `length` payload bytes
+enum MessageType : uint32_t {
+    JobMessage = 1,    // coordinator -> worker: scene and settings as JSON
+    WorkMessage = 2,   // coordinator -> worker: WorkUnit
+    ResultMessage = 3, // worker -> coordinator: WorkUnit followed by the tile's FilmPixels
+    ErrorMessage = 4,  // worker -> coordinator: error text
+    QuitMessage = 5    // coordinator -> worker: job finished
+};
+
+struct MessageHeader {
+    uint32_t type;
+    uint32_t length;
+};
+
+// Samples [sampleBegin, sampleEnd) of every pixel in the tile. Results report the
+// time, rays and BVH node visits the worker spent on them.
+struct WorkUnit {
+    int32_t x0, y0, x1, y1;
+    int32_t sampleBegin, sampleEnd;
+    double seconds;
+    uint64_t rays, nodeVisits;
+
+    Tile tile() const { return {x0, y0, x1, y1}; }
+    size_t pixelCount() const { return static_cast<size_t>(x1 - x0) * (y1 - y0); }
+};
+
+// Whether a result covers exactly the pixels and samples the coordinator asked for
+bool sameWork(const WorkUnit& a, const WorkUnit& b) {
+    return a.x0 == b.x0 && a.y0 == b.y0 && a.x1 == b.x1 && a.y1 == b.y1 && a.sampleBegin == b.sampleBegin &&
+           a.sampleEnd == b.sampleEnd;
+}
+
+bool insideFilm(const WorkUnit& unit, const Film& film) {
+    return unit.x0 >= 0 && unit.y0 >= 0 && unit.x0 < unit.x1 && unit.y0 < unit.y1 && unit.x1 <= film.getWidth() &&
+           unit.y1 <= film.getHeight();
+}
+
+// Payload caps, so a peer cannot make the other side allocate whatever length it sends
+const size_t MaxJobLength = 1 << 20;   // Settings JSON; workers read the scene themselves
+const size_t MaxErrorLength = 1 << 16;
+
+// Largest payload of a message; results carry at most maxPixels film pixels
+size_t maxMessageLength(uint32_t type, size_t maxPixels) {
+    size_t length = 0;
+    switch (type) {
+    case JobMessage: length = MaxJobLength; break;
+    case WorkMessage: length = sizeof(WorkUnit); break;
+    case ResultMessage: length = sizeof(WorkUnit) + maxPixels * sizeof(FilmPixel); break;
+    case ErrorMessage: length = MaxErrorLength; break;
+    case QuitMessage: length = 0; break;
+    }
+    return std::min<size_t>(length, UINT32_MAX);
+}
+
+bool writeAll(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = ::write(fd, bytes, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool readAll(int fd, void* data, size_t size) {
+    char* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t received = ::read(fd, bytes, size);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        bytes += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+bool sendMessage(int fd, MessageType type, const void* payload, size_t length, size_t maxPixels = 0) {
+    if (length > maxMessageLength(type, maxPixels)) return false;
+    MessageHeader header = {type, static_cast<uint32_t>(length)};
+    return writeAll(fd, &header, sizeof(header)) && writeAll(fd, payload, length);
+}
+
+// False when the peer hangs up, or sends an unknown type or a payload longer than the
+// type allows, which leaves the stream unusable either way
+bool receiveMessage(int fd, size_t maxPixels, MessageType& type, std::vector<char>& payload) {
+    MessageHeader header;
+    if (!readAll(fd, &header, sizeof(header))) return false;
+    if (header.type < JobMessage || header.type > QuitMessage || header.length > maxMessageLength(header.type, maxPixels)) {
+        return false;
+    }
+    type = static_cast<MessageType>(header.type);
+    payload.resize(header.length);
+    return readAll(fd, payload.data(), payload.size());
+}
+
+json settingsToJson(const std::string& sceneFile, const RenderSettings& settings) {
+    return {
+        {"scene", sceneFile},
+        {"mode", settings.renderMode},
+        {"spp", settings.samplesPerPixel},
+        {"sampler", settings.samplerName},
+        {"seed", settings.seed},
+        {"light_sampler", settings.lightSamplerName},
+        {"texture_format", settings.textureFormat},
+        {"adaptive", settings.adaptive},
+        {"min_spp", settings.minSamplesPerPixel},
+        {"max_spp", settings.maxSamplesPerPixel},
+        {"threshold", settings.errorThreshold}
+    };
+}
+
+RenderSettings settingsFromJson(const json& job) {
+    RenderSettings settings;
+    settings.renderMode = job.at("mode").get<std::string>();
+    settings.samplesPerPixel = job.at("spp").get<int>();
+    settings.samplerName = job.at("sampler").get<std::string>();
+    settings.seed = job.at("seed").get<uint32_t>();
+    settings.lightSamplerName = job.at("light_sampler").get<std::string>();
+    settings.textureFormat = job.at("texture_format").get<std::string>();
+    settings.adaptive = job.at("adaptive").get<bool>();
+    settings.minSamplesPerPixel = job.at("min_spp").get<int>();
+    settings.maxSamplesPerPixel = job.at("max_spp").get<int>();
+    settings.errorThreshold = job.at("threshold").get<float>();
+    return settings;
+}
+
+// Tiles carry all samples of their pixels, so adaptive sampling works as in a single
+// process. Sample ranges spread every pixel across workers, a few ranges per worker
+// to balance the load.
+std::deque<WorkUnit> makeWorkUnits(const Film& film, const RenderSettings& settings, size_t workerCount) {
+    std::deque<WorkUnit> units;
+    int samples = settings.maxSamples();
+
+    if (settings.farmSplit == "tiles") {
+        for (const Tile& tile : film.makeTiles(settings.tileSize)) {
+            units.push_back({tile.x0, tile.y0, tile.x1, tile.y1, 0, samples, 0.0, 0, 0});
+        }
+    } else if (settings.farmSplit == "samples") {
+        if (settings.adaptive) {
+            throw std::runtime_error("Adaptive sampling needs --farm-split tiles");
+        }
+        int chunks = std::clamp(static_cast<int>(workerCount) * 4, 1, samples);
+        for (int i = 0; i < chunks; ++i) {
+            units.push_back({0, 0, film.getWidth(), film.getHeight(), samples * i / chunks, samples * (i + 1) / chunks,
+                             0.0, 0, 0});
+        }
+    } else {
+        throw std::runtime_error("Unknown farm split: " + settings.farmSplit);
+    }
+    return units;
+}
+
+} // namespace
+
+RenderFarm::RenderFarm(const std::string& sceneFile, const RenderSettings& settings)
+    : sceneFile(sceneFile), settings(settings) {
+    // A worker dying mid-write must surface as a failed write, not kill the coordinator
+    std::signal(SIGPIPE, SIG_IGN);
+}
+
+RenderFarm::~RenderFarm() {
+    shutdown();
+}
+
+void RenderFarm::spawnLocalWorkers(int count) {
+    for (int i = 0; i < count; ++i) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            throw std::runtime_error("Failed to create worker socket: " + std::string(std::strerror(errno)));
+        }
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            ::close(fds[0]);
+            ::close(fds[1]);
+            throw std::runtime_error("Failed to fork worker: " + std::string(std::strerror(errno)));
+        }
+
+        if (pid == 0) {
+            ::close(fds[0]);
+            for (const Worker& worker : workers) {
+                ::close(worker.fd);
+            }
+            runRenderWorker(fds[1]);
+            _exit(0);
+        }
+
+        ::close(fds[1]);
+        workers.push_back({fds[0], pid});
+    }
+}
+
+void RenderFarm::connectWorker(const std::string& address) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        throw std::runtime_error("Worker address must be host:port: " + address);
+    }
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* results = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &results) != 0) {
+        throw std::runtime_error("Failed to resolve worker: " + address);
+    }
+
+    int fd = -1;
+    for (addrinfo* info = results; info && fd < 0; info = info->ai_next) {
+        fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        if (fd >= 0 && ::connect(fd, info->ai_addr, info->ai_addrlen) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(results);
+
+    if (fd < 0) {
+        throw std::runtime_error("Failed to connect to worker: " + address);
+    }
+    workers.push_back({fd, 0});
+}
+
+void RenderFarm::render(Film& film, RenderProfile* profile) {
+    if (workers.empty()) {
+        throw std::runtime_error("Render farm has no workers");
+    }
+
+    std::deque<WorkUnit> pending = makeWorkUnits(film, settings, workers.size());
+    size_t remaining = pending.size();
+
+    std::string job = settingsToJson(sceneFile, settings).dump();
+    std::vector<bool> alive(workers.size(), true);
+    std::vector<bool> busy(workers.size(), false);
+    std::vector<WorkUnit> assigned(workers.size());
+    std::vector<std::chrono::steady_clock::time_point> dispatched(workers.size());
+
+    auto dropWorker = [&](size_t w) {
+        std::cerr << "Render worker " << w << " disconnected\n";
+        alive[w] = false;
+        if (busy[w]) {
+            pending.push_front(assigned[w]);
+            busy[w] = false;
+        }
+    };
+
+    auto dispatch = [&](size_t w) {
+        while (alive[w] && !busy[w] && !pending.empty()) {
+            assigned[w] = pending.front();
+            pending.pop_front();
+            busy[w] = true;
+            dispatched[w] = std::chrono::steady_clock::now();
+            if (!sendMessage(workers[w].fd, WorkMessage, &assigned[w], sizeof(WorkUnit))) {
+                dropWorker(w);
+            }
+        }
+    };
+
+    for (size_t w = 0; w < workers.size(); ++w) {
+        if (!sendMessage(workers[w].fd, JobMessage, job.data(), job.size())) {
+            dropWorker(w);
+        }
+        dispatch(w);
+    }
+
+    std::vector<char> payload;
+    std::vector<FilmPixel> pixels;
+    size_t filmPixels = static_cast<size_t>(film.getWidth()) * film.getHeight();
+    while (remaining > 0) {
+        std::vector<pollfd> polled;
+        std::vector<size_t> polledWorkers;
+        for (size_t w = 0; w < workers.size(); ++w) {
+            if (alive[w] && busy[w]) {
+                polled.push_back({workers[w].fd, POLLIN, 0});
+                polledWorkers.push_back(w);
+            }
+        }
+        if (polled.empty()) {
+            throw std::runtime_error("All render workers disconnected");
+        }
+
+        if (poll(polled.data(), polled.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("poll failed: " + std::string(std::strerror(errno)));
+        }
+
+        for (size_t i = 0; i < polled.size(); ++i) {
+            if (polled[i].revents == 0) continue;
+            size_t w = polledWorkers[i];
+
+            MessageType type;
+            if (!receiveMessage(workers[w].fd, filmPixels, type, payload)) {
+                dropWorker(w);
+            } else if (type == ErrorMessage) {
+                throw std::runtime_error("Render worker failed: " + std::string(payload.begin(), payload.end()));
+            } else if (type == ResultMessage && payload.size() >= sizeof(WorkUnit)) {
+                WorkUnit unit;
+                std::memcpy(&unit, payload.data(), sizeof(WorkUnit));
+                if (!busy[w] || !sameWork(unit, assigned[w]) || !insideFilm(unit, film) ||
+                    payload.size() != sizeof(WorkUnit) + unit.pixelCount() * sizeof(FilmPixel)) {
+                    throw std::runtime_error("Malformed result from render worker");
+                }
+
+                pixels.resize(unit.pixelCount());
+                std::memcpy(pixels.data(), payload.data() + sizeof(WorkUnit), pixels.size() * sizeof(FilmPixel));
+                size_t index = 0;
+                for (int y = unit.y0; y < unit.y1; ++y) {
+                    for (int x = unit.x0; x < unit.x1; ++x) {
+                        film.mergePixel(x, y, pixels[index++]);
+                    }
+                }
+
+                if (profile) {
+                    profile->addTile(profile->track("worker " + std::to_string(w)), unit.tile(), unit.sampleBegin,
+                                     unit.sampleEnd, dispatched[w], {unit.seconds, unit.rays, unit.nodeVisits});
+                }
+
+                busy[w] = false;
+                --remaining;
+                dispatch(w);
+            } else {
+                throw std::runtime_error("Unexpected message from render worker");
+            }
+        }
+
+        // Units handed back by dropped workers go to whoever is idle
+        for (size_t w = 0; w < workers.size(); ++w) {
+            dispatch(w);
+        }
+    }
+
+    shutdown();
+}
+
+void RenderFarm::shutdown() {
+    for (const Worker& worker : workers) {
+        sendMessage(worker.fd, QuitMessage, nullptr, 0);
+        ::close(worker.fd);
+        if (worker.pid > 0) {
+            waitpid(worker.pid, nullptr, 0);
+        }
+    }
+    workers.clear();
+}
+
+void runRenderWorker(int fd) {
+    std::unique_ptr<Scene> scene;
+    std::unique_ptr<Sampler> sampler;
+    std::unique_ptr<Film> film;
+    RenderSettings settings;
+
+    MessageType type;
+    std::vector<char> payload;
+    std::vector<FilmPixel> pixels;
+    while (receiveMessage(fd, 0, type, payload)) {
+        try {
+            if (type == JobMessage) {
+                json job = json::parse(payload.begin(), payload.end());
+                settings = settingsFromJson(job);
+
+                scene = std::make_unique<Scene>();
+                scene->setTextureFormat(parseTextureFormat(settings.textureFormat));
+                scene->loadFromJson(job.at("scene").get<std::string>());
+                scene->buildBVH();
+                scene->finishLoading();
+                scene->setLightSampler(settings.lightSamplerName);
+                if (!scene->getCamera()) {
+                    throw std::runtime_error("Scene has no camera");
+                }
+
+                sampler = createSampler(settings.samplerName, settings.maxSamples(), settings.seed);
+                film = std::make_unique<Film>(scene->getCamera()->getWidth(), scene->getCamera()->getHeight());
+            } else if (type == WorkMessage && payload.size() == sizeof(WorkUnit)) {
+                if (!scene) {
+                    throw std::runtime_error("Work received before a job");
+                }
+
+                WorkUnit unit;
+                std::memcpy(&unit, payload.data(), sizeof(WorkUnit));
+                Tile tile = unit.tile();
+                if (!insideFilm(unit, *film)) {
+                    throw std::runtime_error("Work unit outside the image");
+                }
+
+                film->clear(tile);
+                CostSnapshot start = CostSnapshot::now();
+                scene->getCamera()->renderTile(*scene, settings, *sampler, tile, unit.sampleBegin, unit.sampleEnd, *film);
+                WorkCost cost = start.elapsed();
+                unit.seconds = cost.seconds;
+                unit.rays = cost.rays;
+                unit.nodeVisits = cost.nodeVisits;
+
+                pixels.clear();
+                for (int y = tile.y0; y < tile.y1; ++y) {
+                    for (int x = tile.x0; x < tile.x1; ++x) {
+                        pixels.push_back(film->getPixelData(x, y));
+                    }
+                }
+
+                payload.resize(sizeof(WorkUnit) + pixels.size() * sizeof(FilmPixel));
+                std::memcpy(payload.data(), &unit, sizeof(WorkUnit));
+                std::memcpy(payload.data() + sizeof(WorkUnit), pixels.data(), pixels.size() * sizeof(FilmPixel));
+                if (!sendMessage(fd, ResultMessage, payload.data(), payload.size(), pixels.size())) {
+                    break;
+                }
+            } else if (type == QuitMessage) {
+                break;
+            } else {
+                throw std::runtime_error("Unexpected message from coordinator");
+            }
+        } catch (const std::exception& e) {
+            std::string message = std::string(e.what()).substr(0, MaxErrorLength);
+            sendMessage(fd, ErrorMessage, message.data(), message.size());
+            break;
+        }
+    }
+    ::close(fd);
+}
+
+void listenForRenderJobs(int port, const std::string& bindAddress) {
+    std::signal(SIGPIPE, SIG_IGN);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    addrinfo* results = nullptr;
+    std::string service = std::to_string(port);
+    if (getaddrinfo(bindAddress.c_str(), service.c_str(), &hints, &results) != 0 || !results) {
+        throw std::runtime_error("Failed to resolve bind address: " + bindAddress);
+    }
+
+    int listenFd = socket(results->ai_family, results->ai_socktype, results->ai_protocol);
+    if (listenFd < 0) {
+        freeaddrinfo(results);
+        throw std::runtime_error("Failed to create socket: " + std::string(std::strerror(errno)));
+    }
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    bool listening = bind(listenFd, results->ai_addr, results->ai_addrlen) == 0 && listen(listenFd, 4) == 0;
+    freeaddrinfo(results);
+    if (!listening) {
+        std::string error = std::strerror(errno);
+        ::close(listenFd);
+        throw std::runtime_error("Failed to listen on " + bindAddress + ":" + service + ": " + error);
+    }
+
+    std::cout << "Render worker listening on " << bindAddress << ":" << port << std::endl;
+    while (true) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            ::close(listenFd);
+            throw std::runtime_error("accept failed: " + std::string(std::strerror(errno)));
+        }
+        runRenderWorker(fd);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef RENDERFARM_H
+#define RENDERFARM_H
+
+#include "film.h"
+#include "rendersettings.h"
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// Splits a frame into work units and hands them to worker processes over stream
+// sockets: local workers are forked over socket pairs, remote ones are reached
+// over TCP (see listenForRenderJobs). Workers load the scene themselves, so it
+// must be readable at the same path on every machine. Results stream back as raw
+// film pixels, which assumes workers share the coordinator's architecture.
+class RenderProfile;
+
+class RenderFarm {
+public:
+    RenderFarm(const std::string& sceneFile, const RenderSettings& settings);
+    ~RenderFarm();
+
+    RenderFarm(const RenderFarm&) = delete;
+    RenderFarm& operator=(const RenderFarm&) = delete;
+
+    void spawnLocalWorkers(int count);
+    // Connect to a worker started with --worker-listen, given as "host:port"
+    void connectWorker(const std::string& address);
+
+    // Render every work unit into the film, re-issuing the units of workers that drop out.
+    // With a profile, each unit's cost as measured by its worker goes on that worker's timeline.
+    void render(Film& film, RenderProfile* profile = nullptr);
+
+private:
+    struct Worker {
+        int fd;
+        pid_t pid; // 0 for remote workers
+    };
+
+    std::string sceneFile;
+    RenderSettings settings;
+    std::vector<Worker> workers;
+
+    void shutdown();
+};
+
+// Serve render jobs on a connected socket until the coordinator hangs up
+void runRenderWorker(int fd);
+
+// Accept coordinator connections on a TCP port and serve them one at a time. Workers
+// run whatever jobs reach them unauthenticated, so only the loopback interface listens
+// unless another bind address (e.g. "0.0.0.0" for all) is given explicitly.
+void listenForRenderJobs(int port, const std::string& bindAddress = "127.0.0.1");
+
+#endif
@@ -0,0 +1,167 @@
+#include "renderprofile.h"
+#include "stats.h"
+#include "json.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+using json = nlohmann::json;
+
+CostSnapshot CostSnapshot::now() {
+    return {std::chrono::steady_clock::now(),
+            stats::threadValue(stats::CameraRays) + stats::threadValue(stats::SecondaryRays) +
+                stats::threadValue(stats::ShadowRays),
+            stats::threadValue(stats::BVHNodeVisits)};
+}
+
+WorkCost CostSnapshot::elapsed() const {
+    CostSnapshot end = now();
+    return {std::chrono::duration<double>(end.time - time).count(), end.rays - rays, end.nodeVisits - nodeVisits};
+}
+
+Color heatColor(float t) {
+    return Color(std::clamp(1.5f - std::abs(4.0f * t - 3.0f), 0.0f, 1.0f),
+                 std::clamp(1.5f - std::abs(4.0f * t - 2.0f), 0.0f, 1.0f),
+                 std::clamp(1.5f - std::abs(4.0f * t - 1.0f), 0.0f, 1.0f));
+}
+
+RenderProfile::RenderProfile(int width, int height, const RenderSettings& settings)
+    : width(width), height(height), perPixel(settings.costPerPixel), metric(settings.costMetric),
+      costMapFile(settings.costMapFile), traceFile(settings.traceFile),
+      origin(std::chrono::steady_clock::now()), pixels(static_cast<size_t>(width) * height) {
+    if (metric != "time" && metric != "rays" && metric != "nodes") {
+        throw std::runtime_error("Unknown cost metric: " + metric);
+    }
+}
+
+int RenderProfile::track(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = std::find(trackNames.begin(), trackNames.end(), name);
+    if (it != trackNames.end()) {
+        return static_cast<int>(it - trackNames.begin());
+    }
+    trackNames.push_back(name);
+    return static_cast<int>(trackNames.size()) - 1;
+}
+
+int RenderProfile::currentThreadTrack() {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = threadTracks.find(std::this_thread::get_id());
+    if (it != threadTracks.end()) {
+        return it->second;
+    }
+    int index = static_cast<int>(trackNames.size());
+    trackNames.push_back("render thread " + std::to_string(threadTracks.size()));
+    threadTracks[std::this_thread::get_id()] = index;
+    return index;
+}
+
+// Without per-pixel capture a tile's cost is spread evenly over its pixels
+void RenderProfile::addTile(int track, const Tile& tile, int sampleBegin, int sampleEnd,
+                            std::chrono::steady_clock::time_point start, const WorkCost& cost) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tiles.push_back({track, tile, sampleBegin, sampleEnd, std::chrono::duration<double>(start - origin).count(), cost});
+
+    if (!perPixel) {
+        double share = 1.0 / (static_cast<double>(tile.x1 - tile.x0) * (tile.y1 - tile.y0));
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            for (int x = tile.x0; x < tile.x1; ++x) {
+                WorkCost& pixel = pixels[y * width + x];
+                pixel.seconds += cost.seconds * share;
+                pixel.rays += static_cast<uint64_t>(std::llround(cost.rays * share));
+                pixel.nodeVisits += static_cast<uint64_t>(std::llround(cost.nodeVisits * share));
+            }
+        }
+    }
+}
+
+void RenderProfile::addPixel(int x, int y, const WorkCost& cost) {
+    WorkCost& pixel = pixels[y * width + x];
+    pixel.seconds += cost.seconds;
+    pixel.rays += cost.rays;
+    pixel.nodeVisits += cost.nodeVisits;
+}
+
+void RenderProfile::write() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!costMapFile.empty()) {
+        writeCostMap();
+    }
+    if (!traceFile.empty()) {
+        writeTrace();
+    }
+}
+
+double RenderProfile::metricValue(const WorkCost& cost) const {
+    if (metric == "rays") return static_cast<double>(cost.rays);
+    if (metric == "nodes") return static_cast<double>(cost.nodeVisits);
+    return cost.seconds;
+}
+
+// Blue is the cheapest pixel, red the most expensive
+void RenderProfile::writeCostMap() const {
+    STATS_PHASE(Output);
+    double lowest = std::numeric_limits<double>::max(), highest = 0.0;
+    for (const WorkCost& pixel : pixels) {
+        lowest = std::min(lowest, metricValue(pixel));
+        highest = std::max(highest, metricValue(pixel));
+    }
+    double range = std::max(highest - lowest, 1e-12);
+
+    std::ofstream outFile(costMapFile);
+    if (!outFile) {
+        throw std::runtime_error("Failed to open file: " + costMapFile);
+    }
+
+    outFile << "P3\n" << width << " " << height << "\n255\n";
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            Color heat = heatColor(static_cast<float>((metricValue(pixels[y * width + x]) - lowest) / range));
+            outFile << static_cast<int>(heat.r * 255.0f) << " "
+                    << static_cast<int>(heat.g * 255.0f) << " "
+                    << static_cast<int>(heat.b * 255.0f) << " ";
+        }
+        outFile << "\n";
+    }
+
+    std::string unit = metric == "time" ? " s" : "";
+    std::cout << "Cost map (" << metric << " per pixel): " << lowest << unit << " (blue) to " << highest << unit
+              << " (red)\n";
+}
+
+// Chrome trace-event format, viewable in chrome://tracing or Perfetto: one complete
+// event per tile on the timeline of the thread or worker that rendered it
+void RenderProfile::writeTrace() const {
+    STATS_PHASE(Output);
+    json events = json::array();
+    for (size_t i = 0; i < trackNames.size(); ++i) {
+        events.push_back({{"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", i},
+                          {"args", {{"name", trackNames[i]}}}});
+    }
+
+    for (const TileRecord& record : tiles) {
+        const Tile& tile = record.tile;
+        events.push_back({
+            {"name", "tile " + std::to_string(tile.x0) + "," + std::to_string(tile.y0)},
+            {"cat", "tile"},
+            {"ph", "X"},
+            {"pid", 1},
+            {"tid", record.track},
+            {"ts", record.start * 1e6},
+            {"dur", record.cost.seconds * 1e6},
+            {"args", {{"tile", {tile.x0, tile.y0, tile.x1, tile.y1}},
+                      {"samples", {record.sampleBegin, record.sampleEnd}},
+                      {"rays", record.cost.rays},
+                      {"node_visits", record.cost.nodeVisits}}}
+        });
+    }
+
+    std::ofstream outFile(traceFile);
+    if (!outFile) {
+        throw std::runtime_error("Failed to open file: " + traceFile);
+    }
+    outFile << json({{"traceEvents", events}, {"displayTimeUnit", "ms"}}).dump() << "\n";
+}
@@ -0,0 +1,83 @@
+#ifndef RENDERPROFILE_H
+#define RENDERPROFILE_H
+
+#include "color.h"
+#include "film.h"
+#include "rendersettings.h"
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Time, rays and BVH node visits spent on a piece of rendering work. Rays and node
+// visits come from the statistics counters and stay zero when those are compiled out.
+struct WorkCost {
+    double seconds = 0.0;
+    uint64_t rays = 0;
+    uint64_t nodeVisits = 0;
+};
+
+// Clock and the calling thread's counters at one instant
+struct CostSnapshot {
+    std::chrono::steady_clock::time_point time;
+    uint64_t rays;
+    uint64_t nodeVisits;
+
+    static CostSnapshot now();
+    // Cost of the calling thread's work since this snapshot
+    WorkCost elapsed() const;
+};
+
+// False-colour ramp from blue (0) through green to red (1)
+Color heatColor(float t);
+
+// Records where render time goes, per tile and optionally per pixel, to find hot
+// regions of a frame and load imbalance between threads or farm workers. Tiles may
+// be recorded from any thread; pixels only by the thread rendering their tile.
+class RenderProfile {
+public:
+    RenderProfile(int width, int height, const RenderSettings& settings);
+
+    bool capturesPixels() const { return perPixel; }
+
+    // Trace timeline with the given name, or the calling thread's
+    int track(const std::string& name);
+    int currentThreadTrack();
+
+    void addTile(int track, const Tile& tile, int sampleBegin, int sampleEnd,
+                 std::chrono::steady_clock::time_point start, const WorkCost& cost);
+    void addPixel(int x, int y, const WorkCost& cost);
+
+    // Cost map and trace, as requested by the settings
+    void write() const;
+
+private:
+    struct TileRecord {
+        int track;
+        Tile tile;
+        int sampleBegin, sampleEnd;
+        double start; // seconds since the profile was created
+        WorkCost cost;
+    };
+
+    int width, height;
+    bool perPixel;
+    std::string metric;
+    std::string costMapFile, traceFile;
+    std::chrono::steady_clock::time_point origin;
+
+    mutable std::mutex mutex;
+    std::vector<std::string> trackNames;
+    std::map<std::thread::id, int> threadTracks;
+    std::vector<TileRecord> tiles;
+    std::vector<WorkCost> pixels; // accumulated over passes
+
+    double metricValue(const WorkCost& cost) const;
+    void writeCostMap() const;
+    void writeTrace() const;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef RENDERSETTINGS_H
+#define RENDERSETTINGS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct RenderSettings {
+    std::string renderMode = "phong";
+    int samplesPerPixel = 1;
+    std::string samplerName = "sobol";
+    uint32_t seed = 0; // Every sample value derives from it, so equal seeds give identical images
+    std::string lightSamplerName = "power";
+    std::string textureFormat = "float"; // float, fp16, rgba8, rgb8 or bc1
+    int tileSize = 32;
+
+    // Adaptive sampling: stop a pixel once the standard error of its mean
+    // luminance, relative to the mean, drops below errorThreshold
+    bool adaptive = false;
+    int minSamplesPerPixel = 16;
+    int maxSamplesPerPixel = 0; // 0 uses samplesPerPixel
+    float errorThreshold = 0.02f;
+    std::string heatmapFile; // Sample-count heatmap, written when non-empty
+
+    // Progressive rendering: passes doubling the samples per pixel up to maxSamples(),
+    // rewriting the image after each, stopped early by a wall-clock budget in seconds
+    // or an average relative error target (0 disables either)
+    bool progressive = false;
+    float timeBudget = 0.0f;
+    float noiseTarget = 0.0f;
+
+    // Checkpointing: the film is saved to checkpointFile every checkpointInterval
+    // seconds (when non-empty), and resume continues from that file
+    std::string checkpointFile;
+    float checkpointInterval = 60.0f;
+    bool resume = false;
+
+    // Distributed rendering: forked local workers and/or remote "host:port" workers,
+    // splitting the frame by "tiles" or by "samples" ranges
+    int farmWorkers = 0;
+    static constexpr int MaxFarmWorkers = 256;
+    std::vector<std::string> farmHosts;
+    std::string farmSplit = "tiles";
+
+    // Cost capture: a false-colour map of the render "time", "rays" or "nodes" spent
+    // per pixel (measured per tile unless costPerPixel) and a Chrome trace-event file
+    // with each thread's or worker's tile timeline, each written when non-empty
+    std::string costMapFile;
+    std::string costMetric = "time";
+    bool costPerPixel = false;
+    std::string traceFile;
+
+    // Denoising: first-hit albedo, normal and depth buffers guide denoiseIterations
+    // passes of an edge-avoiding filter over the image; aovPrefix, when non-empty, also
+    // writes those buffers as <prefix>_albedo.ppm, _normal.ppm and _depth.ppm
+    bool denoise = false;
+    int denoiseIterations = 5;
+    static constexpr int MaxDenoiseIterations = 10; // The last pass spreads its taps 2^9 pixels apart
+    std::string aovPrefix;
+
+    // Largest number of samples any pixel can receive
+    int maxSamples() const {
+        return adaptive && maxSamplesPerPixel > 0 ? maxSamplesPerPixel : samplesPerPixel;
+    }
+
+    bool needsAOVs() const { return denoise || !aovPrefix.empty(); }
+};
+
+#endif
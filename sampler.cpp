@@ -0,0 +1,222 @@
+#include "sampler.h"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace {
+
+const float OneMinusEpsilon = 0x1.fffffep-1f;
+
+const int NumPrimes = 64;
+const int Primes[NumPrimes] = {
+    2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+    59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131,
+    137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223,
+    227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311
+};
+
+uint64_t mixBits(uint64_t v) {
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185ULL;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44dULL;
+    v ^= v >> 33;
+    return v;
+}
+
+uint64_t hashCombine(uint64_t a, uint64_t b) {
+    return mixBits(a ^ (b + 0x9e3779b97f4a7c15ULL + (a << 6) + (a >> 2)));
+}
+
+uint32_t reverseBits(uint32_t v) {
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+// Hash-based Owen scrambling (Burley 2020): every bit is flipped depending on the
+// bits above it, which keeps the stratification of the underlying point set
+uint32_t owenScramble(uint32_t v, uint32_t seed) {
+    v = reverseBits(v);
+    v += seed;
+    v ^= v * 0x6c50b47cu;
+    v ^= v * 0xb82f1e52u;
+    v ^= v * 0xc7afe638u;
+    v ^= v * 0x8d22f6e6u;
+    return reverseBits(v);
+}
+
+// Bijection on [0, length) selected by `seed` (Kensler 2013)
+uint32_t permutationElement(uint32_t i, uint32_t length, uint32_t seed) {
+    uint32_t w = length - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= seed;
+        i *= 0xe170893d;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3f;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= length);
+    return (i + seed) % length;
+}
+
+// Philox4x32-10 (Salmon et al. 2011): ten rounds of multiply-xorshift over a 128-bit
+// counter with a 64-bit key, a bijection per key that passes BigCrush
+std::array<uint32_t, 4> philox(std::array<uint32_t, 4> counter, uint32_t key0, uint32_t key1) {
+    for (int round = 0; round < 10; ++round) {
+        uint64_t product0 = static_cast<uint64_t>(0xD2511F53u) * counter[0];
+        uint64_t product1 = static_cast<uint64_t>(0xCD9E8D57u) * counter[2];
+        counter = {static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ key0, static_cast<uint32_t>(product1),
+                   static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ key1, static_cast<uint32_t>(product0)};
+        key0 += 0x9E3779B9u;
+        key1 += 0xBB67AE85u;
+    }
+    return counter;
+}
+
+float toUnitFloat(uint32_t v) {
+    return std::min(v * 0x1p-32f, OneMinusEpsilon);
+}
+
+// First two dimensions of the Sobol sequence
+uint32_t sobolDimension0(uint32_t index) {
+    return reverseBits(index);
+}
+
+uint32_t sobolDimension1(uint32_t index) {
+    uint32_t result = 0;
+    for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1) {
+        if (index & 1) result ^= v;
+    }
+    return result;
+}
+
+// Radical inverse in the given base with every digit permuted depending on the
+// digits before it, i.e. Owen scrambling generalised to arbitrary bases
+float owenScrambledRadicalInverse(int base, uint64_t index, uint64_t hash) {
+    double invBase = 1.0 / base;
+    double invBaseM = 1.0;
+    uint64_t reversedDigits = 0;
+
+    // Enough digits to fill the float mantissa
+    while (invBaseM > 0x1p-25) {
+        uint64_t next = index / base;
+        uint32_t digit = static_cast<uint32_t>(index - next * base);
+        uint32_t digitHash = static_cast<uint32_t>(mixBits(hash ^ reversedDigits));
+        digit = permutationElement(digit, base, digitHash);
+        reversedDigits = reversedDigits * base + digit;
+        invBaseM *= invBase;
+        index = next;
+    }
+    return std::min(static_cast<float>(invBaseM * reversedDigits), OneMinusEpsilon);
+}
+
+} // namespace
+
+RandomSampler::RandomSampler(uint32_t seed) : seed(seed) {}
+
+void RandomSampler::startPixelSample(int x, int y, int index) {
+    pixelX = static_cast<uint32_t>(x);
+    pixelY = static_cast<uint32_t>(y);
+    sampleIndex = static_cast<uint32_t>(index);
+    dimension = 0;
+}
+
+float RandomSampler::get1D() {
+    return toUnitFloat(philox({pixelX, pixelY, sampleIndex, dimension++}, seed, 0x6A09E667u)[0]);
+}
+
+// Both values come from one block, so a 2D sample takes a single dimension
+void RandomSampler::get2D(float &u, float &v) {
+    std::array<uint32_t, 4> block = philox({pixelX, pixelY, sampleIndex, dimension++}, seed, 0x6A09E667u);
+    u = toUnitFloat(block[0]);
+    v = toUnitFloat(block[1]);
+}
+
+HaltonSampler::HaltonSampler(uint32_t seed) : seed(seed) {}
+
+void HaltonSampler::startPixelSample(int x, int y, int index) {
+    pixelHash = hashCombine(hashCombine(seed, static_cast<uint32_t>(x)), static_cast<uint32_t>(y));
+    sampleIndex = static_cast<uint32_t>(index);
+    dimension = 0;
+}
+
+float HaltonSampler::sampleDimension(int dim) const {
+    uint64_t hash = hashCombine(pixelHash, static_cast<uint64_t>(dim));
+    if (dim < NumPrimes) {
+        return owenScrambledRadicalInverse(Primes[dim], sampleIndex, hash);
+    }
+    // Past the prime table fall back to scrambled base-2 points
+    return toUnitFloat(owenScramble(sobolDimension0(sampleIndex), static_cast<uint32_t>(hash)));
+}
+
+float HaltonSampler::get1D() {
+    return sampleDimension(dimension++);
+}
+
+void HaltonSampler::get2D(float &u, float &v) {
+    u = sampleDimension(dimension++);
+    v = sampleDimension(dimension++);
+}
+
+SobolSampler::SobolSampler(int samplesPerPixel, uint32_t seed)
+    : samplesPerPixel(static_cast<uint32_t>(std::max(1, samplesPerPixel))), seed(seed) {}
+
+void SobolSampler::startPixelSample(int x, int y, int index) {
+    pixelHash = hashCombine(hashCombine(seed, static_cast<uint32_t>(x)), static_cast<uint32_t>(y));
+    sampleIndex = static_cast<uint32_t>(index);
+    dimension = 0;
+}
+
+// Each dimension visits the pixel's samples in its own order, which decorrelates
+// the padded dimensions from each other
+uint32_t SobolSampler::shuffledIndex(uint64_t dimensionHash) const {
+    if (sampleIndex >= samplesPerPixel) {
+        return sampleIndex;
+    }
+    return permutationElement(sampleIndex, samplesPerPixel, static_cast<uint32_t>(dimensionHash));
+}
+
+float SobolSampler::get1D() {
+    uint64_t hash = hashCombine(pixelHash, static_cast<uint64_t>(dimension++));
+    uint32_t index = shuffledIndex(hash);
+    return toUnitFloat(owenScramble(sobolDimension0(index), static_cast<uint32_t>(hash >> 32)));
+}
+
+void SobolSampler::get2D(float &u, float &v) {
+    uint64_t hash = hashCombine(pixelHash, static_cast<uint64_t>(dimension++));
+    uint32_t index = shuffledIndex(hash);
+    uint64_t scrambleHash = mixBits(hash);
+    u = toUnitFloat(owenScramble(sobolDimension0(index), static_cast<uint32_t>(scrambleHash)));
+    v = toUnitFloat(owenScramble(sobolDimension1(index), static_cast<uint32_t>(scrambleHash >> 32)));
+}
+
+std::unique_ptr<Sampler> createSampler(const std::string &name, int samplesPerPixel, uint32_t seed) {
+    if (name == "random") {
+        return std::make_unique<RandomSampler>(seed);
+    } else if (name == "halton") {
+        return std::make_unique<HaltonSampler>(seed);
+    } else if (name == "sobol") {
+        return std::make_unique<SobolSampler>(samplesPerPixel, seed);
+    }
+    throw std::runtime_error("Unknown sampler: " + name);
+}
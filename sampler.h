@@ -0,0 +1,87 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Source of sample values for the camera and the integrators. Every camera sample
+// consumes dimensions in the same order, whichever sampler is in use:
+//   pixel jitter (2D), lens position (2D), then for each path vertex
+//   light selection (1D), light position (2D), BSDF lobe (1D) and BSDF direction (2D).
+// Samplers hand out consecutive dimensions, so keeping that order at every call
+// site keeps the low-discrepancy dimensions aligned between pixels and samples.
+//
+// Every value is a pure function of (seed, pixel, sample index, dimension), so a
+// render is reproducible whichever thread, tile, worker or checkpoint produced a
+// sample.
+class Sampler {
+public:
+    virtual ~Sampler() = default;
+
+    // Start sample `sampleIndex` of pixel (x, y) and reset the dimension counter
+    virtual void startPixelSample(int x, int y, int sampleIndex) = 0;
+    virtual float get1D() = 0;
+    virtual void get2D(float &u, float &v) = 0;
+};
+
+// Independent uniform random numbers from a counter-based generator: Philox4x32-10
+// of (pixel x, pixel y, sample index, dimension) keyed by the seed
+class RandomSampler : public Sampler {
+public:
+    explicit RandomSampler(uint32_t seed = 0);
+
+    void startPixelSample(int x, int y, int sampleIndex) override;
+    float get1D() override;
+    void get2D(float &u, float &v) override;
+
+private:
+    uint32_t seed;
+    uint32_t pixelX = 0, pixelY = 0;
+    uint32_t sampleIndex = 0;
+    uint32_t dimension = 0;
+};
+
+// Halton sequence with per-pixel Owen scrambling of the digits
+class HaltonSampler : public Sampler {
+public:
+    explicit HaltonSampler(uint32_t seed = 0);
+
+    void startPixelSample(int x, int y, int sampleIndex) override;
+    float get1D() override;
+    void get2D(float &u, float &v) override;
+
+private:
+    uint32_t seed;
+    uint64_t pixelHash = 0;
+    uint32_t sampleIndex = 0;
+    int dimension = 0;
+
+    float sampleDimension(int dim) const;
+};
+
+// Owen-scrambled Sobol (0,2)-sequence padded across dimension pairs: each 2D
+// dimension draws from the first two Sobol dimensions with its own sample order
+// and scramble, which supports an unlimited number of dimensions
+class SobolSampler : public Sampler {
+public:
+    SobolSampler(int samplesPerPixel, uint32_t seed = 0);
+
+    void startPixelSample(int x, int y, int sampleIndex) override;
+    float get1D() override;
+    void get2D(float &u, float &v) override;
+
+private:
+    uint32_t samplesPerPixel;
+    uint32_t seed;
+    uint64_t pixelHash = 0;
+    uint32_t sampleIndex = 0;
+    int dimension = 0;
+
+    uint32_t shuffledIndex(uint64_t dimensionHash) const;
+};
+
+// Create a sampler by name: "random", "halton" or "sobol"
+std::unique_ptr<Sampler> createSampler(const std::string &name, int samplesPerPixel, uint32_t seed = 0);
+
+#endif
@@ -0,0 +1,34 @@
+#!/bin/sh
+# End-to-end scaling benchmark: generates scenes of growing size with scenegen,
+# renders each one and prints a CSV of build time, peak memory and throughput.
+#
+#   ./scaling_benchmark.sh [distribution] [mode] [spp] [counts...]
+#
+# Example: ./scaling_benchmark.sh clustered pathtracer 4 1000 10000 100000
+# Extra scenegen options can be passed in SCENEGEN_OPTIONS, for instance
+# SCENEGEN_OPTIONS="--cylinders 500 --lights 16 --textures 4 --textured 0.3".
+set -e
+
+DISTRIBUTION=${1:-uniform}
+MODE=${2:-phong}
+SPP=${3:-1}
+[ $# -gt 3 ] && shift 3 || set -- 1000 10000 100000 1000000
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+make -s raytracer scenegen >&2
+
+# Value of a numeric field in the stats JSON, which has one field per line
+field() {
+    sed -n "s/^ *\"$1\": *\([-0-9.e+]*\),\{0,1\}$/\1/p" "$2"
+}
+
+echo "distribution,spheres,parse_s,texture_load_s,bvh_build_s,render_s,rays,mrays_per_s,peak_memory_mb"
+for COUNT in "$@"; do
+    SCENE="$WORK/scene_$COUNT.json"
+    ./scenegen --spheres "$COUNT" --distribution "$DISTRIBUTION" $SCENEGEN_OPTIONS -o "$SCENE"
+    ./raytracer "$MODE" "$SCENE" --spp "$SPP" --output "$WORK/out.ppm" --stats-json "$WORK/stats.json" > /dev/null
+    S="$WORK/stats.json"
+    echo "$DISTRIBUTION,$COUNT,$(field parse "$S"),$(field texture_load "$S"),$(field bvh_build "$S"),$(field render "$S"),$(field rays "$S"),$(field mrays_per_second "$S"),$(field peak_memory_mb "$S")"
+done
@@ -1,45 +1,107 @@
 #include "scene.h"
 #include "json.hpp"
+#include <cstdio>
 #include <fstream>
+#include <iterator>
 #include <limits>
 #include <cmath>
 #include <algorithm>
-#include <random>
+#include <stdexcept>
+#include <thread>
 #include "bvhnode.h"
 #include "boundingbox.h"
 #include "texture.h"
+#include "stats.h"
 
 using json = nlohmann::json;
 
-void Scene::addSphere(const Vector3 &center, float radius, const Color &color, float reflectivity, float transparency, float refractiveIndex, Texture* texture) {
-    spheres.emplace_back(new Sphere(center, radius, color, reflectivity, transparency, refractiveIndex, texture));
+Scene::~Scene() {
+    for (Sphere* sphere : spheres) delete sphere;
+    for (Triangle* triangle : triangles) delete triangle;
+    for (Cylinder* cylinder : cylinders) delete cylinder;
+    delete camera;
 }
 
-void Scene::addTriangle(const Vector3 &v0, const Vector3 &v1, const Vector3 &v2, const Color &color, float reflectivity, float transparency, float refractiveIndex, Texture* texture) {
-    triangles.emplace_back(new Triangle(v0, v1, v2, color, reflectivity, transparency, refractiveIndex, texture));
+MaterialId Scene::addMaterial(const Material &material, const std::string &name) {
+    MaterialId id = static_cast<MaterialId>(materials.size());
+    materials.push_back(material);
+    if (!name.empty()) {
+        materialNames[name] = id;
+    }
+    return id;
+}
+
+// Each file is loaded once and shared between all materials referencing it. Loads run
+// in parallel while parsing and the BVH build continue on the calling thread, so the
+// texture_load phase sums the time of all loader threads.
+void Scene::requestTexture(MaterialId material, const std::string &filename) {
+    textureBindings.emplace_back(material, filename);
+    if (textures.count(filename) || pendingTextures.count(filename)) {
+        return;
+    }
+
+    if (!loaderPool) {
+        loaderPool = std::make_unique<ThreadPool>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    auto load = std::make_shared<std::packaged_task<std::unique_ptr<Texture>()>>([filename, format = textureFormat] {
+        STATS_PHASE(TextureLoad);
+        return std::make_unique<Texture>(filename, format);
+    });
+    pendingTextures[filename] = load->get_future();
+    loaderPool->submit([load] { (*load)(); });
+}
+
+void Scene::finishLoading() {
+    for (auto &[filename, pending] : pendingTextures) {
+        std::unique_ptr<Texture> texture = pending.get();
+        STATS_ADD(TextureBytes, texture->getMemoryBytes());
+        textures[filename] = texture->isLoaded() ? std::move(texture) : nullptr;
+    }
+    pendingTextures.clear();
+    loaderPool.reset();
+
+    for (const auto &[material, filename] : textureBindings) {
+        materials[material].texture = textures[filename].get();
+    }
+    textureBindings.clear();
+}
+
+void Scene::addSphere(const Vector3 &center, float radius, MaterialId materialId) {
+    spheres.emplace_back(new Sphere(center, radius, materialId));
+}
+
+void Scene::addTriangle(const Vector3 &v0, const Vector3 &v1, const Vector3 &v2, MaterialId materialId) {
+    triangles.emplace_back(new Triangle(v0, v1, v2, materialId));
 }
 
-void Scene::addCylinder(const Vector3 &center, const Vector3 &axis, float radius, float height, const Color &color, float reflectivity, float transparency, float refractiveIndex, Texture* texture) {
-    cylinders.emplace_back(new Cylinder(center, axis, radius, height, color, reflectivity, transparency, refractiveIndex, texture));
+void Scene::addCylinder(const Vector3 &center, const Vector3 &axis, float radius, float height, MaterialId materialId) {
+    cylinders.emplace_back(new Cylinder(center, axis, radius, height, materialId));
 }
 
 void Scene::addLight(const Vector3 &position, float intensity, const Color &color, 
                      bool areaLight, const Vector3 &normal, float width, float height) {
     if (areaLight) {
-        Vector3 tangent = Vector3(1, 0, 0).cross(normal).normalize();
+        // Width runs along normal x z, as scene files have always laid area lights out;
+        // normals along z fall back to normal x y
+        Vector3 unitNormal = normal.normalize();
+        Vector3 tangent = unitNormal.cross(Vector3(0, 0, 1));
         if (tangent.length() < 1e-6f) {
-            tangent = Vector3(0, 1, 0).cross(normal).normalize();
+            tangent = unitNormal.cross(Vector3(0, 1, 0));
         }
-        Vector3 bitangent = normal.cross(tangent).normalize();
+        tangent = tangent.normalize();
+        Vector3 bitangent = unitNormal.cross(tangent).normalize();
 
-        lights.push_back({position, intensity, color, true, normal, width, height, tangent * width, bitangent * height});
+        lights.push_back({position, intensity, color, true, unitNormal, width, height, tangent, bitangent});
     } else {
         lights.push_back({position, intensity, color, false, normal, width, height, {}, {}});
     }
+    lightBVH.reset();
+    lightSampler.reset();
 }
 
 // Build BVH for the scene
 void Scene::buildBVH() {
+    STATS_PHASE(BVHBuild);
     std::vector<BVHNode::Primitive> primitives;
 
     // Add spheres to primitives
@@ -62,6 +124,17 @@ void Scene::buildBVH() {
 
     // Build the BVH tree
     bvhRoot = BVHNode::build(primitives, 0);
+
+    // Lights get their own hierarchy for finding the emitter hit by a ray
+    lightBVH = std::make_shared<LightBVH>(lights);
+    lightSampler = createLightSampler(lightSamplerName, lights, lightBVH);
+}
+
+void Scene::setLightSampler(const std::string &name) {
+    lightSamplerName = name;
+    if (lightBVH) {
+        lightSampler = createLightSampler(name, lights, lightBVH);
+    }
 }
 
 // Trace a ray against the BVH
@@ -72,45 +145,145 @@ bool Scene::traceRay(const Ray &ray) const {
     return false;
 }
 
+// Find the closest hit and resolve its shading data from the material table
+bool Scene::intersect(const Ray &ray, float maxDistance, HitRecord &hit) const {
+    const BVHNode::Primitive* primitive = nullptr;
+    int part = 0;
+    float closestDistance = maxDistance;
+    if (!bvhRoot || !bvhRoot->trace(ray, closestDistance, primitive, part)) {
+        return false;
+    }
+
+    hit.distance = closestDistance;
+    hit.point = primitive->getSurfacePoint(ray, closestDistance, part);
+    hit.error = hitPointError(ray.origin, hit.point, closestDistance);
+    hit.normal = primitive->getNormal(hit.point, part);
+    hit.primitive = primitive;
+    hit.material = &materials[primitive->getMaterialId()];
+
+    // The auxiliary rays are intersected with the tangent plane at the hit point
+    hit.hasDifferentials = false;
+    if (ray.hasDifferentials) {
+        float dxCos = hit.normal.dot(ray.dxDirection);
+        float dyCos = hit.normal.dot(ray.dyDirection);
+        if (dxCos != 0.0f && dyCos != 0.0f) {
+            float plane = hit.normal.dot(hit.point);
+            hit.dpdx = Vector3::madd(ray.dxDirection, (plane - hit.normal.dot(ray.dxOrigin)) / dxCos, ray.dxOrigin) - hit.point;
+            hit.dpdy = Vector3::madd(ray.dyDirection, (plane - hit.normal.dot(ray.dyOrigin)) / dyCos, ray.dyOrigin) - hit.point;
+            hit.hasDifferentials = true;
+        }
+    }
+
+    hit.color = hit.material->color;
+    if (hit.material->texture) {
+        float u, v;
+        primitive->getTextureCoordinates(hit.point, part, u, v);
+        if (hit.hasDifferentials) {
+            float ux, vx, uy, vy;
+            primitive->getTextureCoordinates(hit.point + hit.dpdx, part, ux, vx);
+            primitive->getTextureCoordinates(hit.point + hit.dpdy, part, uy, vy);
+            // Coordinates wrap, so differences across a seam are taken the short way round
+            auto difference = [](float a, float b) { return a - b - std::round(a - b); };
+            hit.color = hit.material->getColor(u, v, difference(ux, u), difference(vx, v), difference(uy, u), difference(vy, v));
+        } else {
+            hit.color = hit.material->getColor(u, v);
+        }
+    }
+    return true;
+}
+
+namespace {
+
+// Carries a ray's differentials across a specular bounce: the auxiliary rays leave from
+// where they met the tangent plane, turned by the same rule as the main ray. The normal
+// is taken as constant over the footprint, which ignores the spread added by curvature.
+template <typename Bend>
+void transferDifferentials(const Ray &incoming, const HitRecord &hit, Ray &outgoing, Bend bend) {
+    if (!incoming.hasDifferentials || !hit.hasDifferentials) {
+        return;
+    }
+    outgoing.hasDifferentials = true;
+    outgoing.dxOrigin = hit.point + hit.dpdx;
+    outgoing.dyOrigin = hit.point + hit.dpdy;
+    outgoing.dxDirection = bend(incoming.dxDirection);
+    outgoing.dyDirection = bend(incoming.dyDirection);
+}
+
+Vector3 reflect(const Vector3 &direction, const Vector3 &normal) {
+    return direction - 2 * direction.dot(normal) * normal;
+}
+
+// Refraction into a medium with relative index 1 / eta across the normal facing the
+// incoming direction; total internal reflection falls back to the mirror direction
+Vector3 refract(const Vector3 &direction, const Vector3 &normal, float eta) {
+    float cosTheta = -normal.dot(direction);
+    float k = 1 - eta * eta * (1 - cosTheta * cosTheta);
+    if (k < 0.0f) {
+        return reflect(direction, normal);
+    }
+    return (eta * direction + (eta * cosTheta - std::sqrt(k)) * normal).normalize();
+}
+
+} // namespace
+
+bool Scene::occluded(const Ray &ray, float maxDistance) const {
+    auto stop = [](const BVHNode::Primitive &, float, int) { return false; };
+    return bvhRoot && !bvhRoot->visitHits(ray, maxDistance, stop);
+}
+
+Color Scene::transmittance(const Ray &ray, float maxDistance) const {
+    Color transmission = {1.0f, 1.0f, 1.0f};
+    if (!bvhRoot) {
+        return transmission;
+    }
+
+    auto filter = [&](const BVHNode::Primitive &primitive, float distance, int part) {
+        const Material &material = materials[primitive.getMaterialId()];
+        if (material.transparency <= 0.0f) {
+            transmission = {0.0f, 0.0f, 0.0f};
+            return false;
+        }
+
+        Color color = material.color;
+        if (material.texture) {
+            float u, v;
+            primitive.getTextureCoordinates(primitive.getSurfacePoint(ray, distance, part), part, u, v);
+            color = material.getColor(u, v);
+        }
+        transmission = transmission * color * material.transparency;
+        return std::max({transmission.r, transmission.g, transmission.b}) > 0.0f;
+    };
+    bvhRoot->visitHits(ray, maxDistance, filter);
+    return transmission;
+}
+
 // Ray tracing with shading
 Color Scene::traceRayWithShading(const Ray &ray, int depth) const {
     if (depth <= 0) {
         return {0.0f, 0.0f, 0.0f}; // Stop recursion
     }
 
-    float closestDistance = std::numeric_limits<float>::max();
-    Vector3 hitPoint, normal;
-    Color objectColor;
-    float reflectivity = 0.0f, transparency = 0.0f, refractiveIndex = 1.0f;
+    HitRecord hit;
+    if (intersect(ray, std::numeric_limits<float>::max(), hit)) {
+        const Vector3 &hitPoint = hit.point;
+        const Vector3 &normal = hit.normal;
+        const Color &objectColor = hit.color;
+        float reflectivity = hit.material->reflectivity;
+        float transparency = hit.material->transparency;
+        float refractiveIndex = hit.material->refractiveIndex;
 
-    if (bvhRoot && bvhRoot->trace(ray, closestDistance, hitPoint, normal, objectColor, reflectivity, transparency, refractiveIndex)) {
         Color finalColor = {0.0f, 0.0f, 0.0f};
         Vector3 viewDir = -ray.direction.normalize();
 
         // Shadow ray and light contribution
         for (const auto &light : lights) {
             Vector3 lightDir = (light.position - hitPoint).normalize();
-            Ray shadowRay(hitPoint + normal * 1e-4, lightDir); // Avoid self-intersection
-            Color lightTransmission = {1.0f, 1.0f, 1.0f};
-            float lightDistance = (light.position - hitPoint).length();
-            bool inShadow = false;
-
-            // Trace shadow ray through the BVH
-            float shadowClosest = lightDistance; // Limit shadow ray to light distance
-            while (bvhRoot->trace(shadowRay, shadowClosest, hitPoint, normal, objectColor, reflectivity, transparency, refractiveIndex)) {
-                if (transparency > 0.0f) {
-                    lightTransmission = lightTransmission * objectColor * transparency;
-                    shadowRay = Ray(hitPoint + shadowRay.direction * 1e-4, shadowRay.direction);
-                    shadowClosest = lightDistance; // Reset for subsequent intersections
-                } else {
-                    lightTransmission = {0.0f, 0.0f, 0.0f};
-                    inShadow = true;
-                    break;
-                }
-            }
+            Ray shadowRay = spawnRay(hit, lightDir);
+            STATS_ADD(ShadowRays, 1);
+            Color lightTransmission = transmittance(shadowRay, (light.position - shadowRay.origin).length());
 
             // Apply shading if the light is not completely blocked
-            if (!inShadow) {
+            if (std::max({lightTransmission.r, lightTransmission.g, lightTransmission.b}) > 0.0f) {
                 float diff = std::max(0.0f, normal.dot(lightDir));
                 Vector3 reflectDir = (2 * normal.dot(lightDir) * normal - lightDir).normalize();
                 float spec = std::pow(std::max(0.0f, viewDir.dot(reflectDir)), 32);
@@ -123,8 +296,10 @@ Color Scene::traceRayWithShading(const Ray &ray, int depth) const {
         }
 
         // Reflection
-        Vector3 reflectionDir = ray.direction - 2 * ray.direction.dot(normal) * normal;
-        Ray reflectedRay(hitPoint + reflectionDir * 1e-4, reflectionDir);
+        Vector3 reflectionDir = reflect(ray.direction, normal);
+        Ray reflectedRay = spawnRay(hit, reflectionDir);
+        transferDifferentials(ray, hit, reflectedRay, [&](const Vector3 &d) { return reflect(d, normal); });
+        STATS_ADD(SecondaryRays, 1);
         Color reflectionColor = traceRayWithShading(reflectedRay, depth - 1) * reflectivity;
 
         // Refraction
@@ -137,7 +312,9 @@ Color Scene::traceRayWithShading(const Ray &ray, int depth) const {
             if (k >= 0.0f) {
                 Vector3 refractionDir = eta * ray.direction + (eta * cosTheta - std::sqrt(k)) * normal;
                 refractionDir = refractionDir.normalize();
-                Ray refractedRay(hitPoint + refractionDir * 1e-4, refractionDir);
+                Ray refractedRay = spawnRay(hit, refractionDir);
+                transferDifferentials(ray, hit, refractedRay, [&](const Vector3 &d) { return refract(d, normal, eta); });
+                STATS_ADD(SecondaryRays, 1);
                 refractionColor = traceRayWithShading(refractedRay, depth - 1) * transparency;
             }
         }
@@ -151,121 +328,193 @@ Color Scene::traceRayWithShading(const Ray &ray, int depth) const {
     return {0.0f, 0.0f, 0.0f}; // Background color
 }
 
-Color Scene::traceRayWithBRDF(const Ray &ray, int depth) const {
-    if (depth <= 0) {
-        return {0.0f, 0.0f, 0.0f}; // Stop recursion
-    }
+namespace {
 
-    float closestDistance = std::numeric_limits<float>::max();
-    Vector3 hitPoint, normal;
-    Color objectColor;
-    float reflectivity = 0.0f, transparency = 0.0f, refractiveIndex = 1.0f;
+// Power heuristic (beta = 2) for combining two sampling strategies
+float powerHeuristic(float pdf, float otherPdf) {
+    float a = pdf * pdf;
+    float b = otherPdf * otherPdf;
+    return a + b > 0.0f ? a / (a + b) : 0.0f;
+}
 
-    if (bvhRoot && bvhRoot->trace(ray, closestDistance, hitPoint, normal, objectColor, reflectivity, transparency, refractiveIndex)) {
-        Color finalColor = {0.0f, 0.0f, 0.0f};
-        Vector3 viewDir = -ray.direction.normalize();
+// Convert an area density on a light to a solid-angle density at the shading point
+float areaToSolidAngle(float areaPdf, float distance, const Vector3& lightNormal, const Vector3& direction) {
+    float cosLight = std::abs(lightNormal.dot(direction));
+    return cosLight > 0.0f ? areaPdf * distance * distance / cosLight : 0.0f;
+}
 
-        // **Light Sampling and Soft Shadows**
-        const int numLightSamples = 16; // Number of samples for soft shadows
-        for (const auto &light : lights) {
-            Color lightContribution = {0.0f, 0.0f, 0.0f};
+} // namespace
 
-            for (int i = 0; i < numLightSamples; ++i) {
-                Vector3 sampledPoint;
-                float pdf;
-                Light sampledLight = sampleLight(hitPoint, sampledPoint, pdf);
+// Path tracer with next-event estimation. Every diffuse vertex takes one light
+// sample and one BSDF sample; emitters reached by either strategy are weighted
+// with the power heuristic so each light path is counted once.
+Color Scene::traceRayWithBRDF(const Ray &cameraRay, Sampler &sampler, int depth) const {
+    Color radiance = {0.0f, 0.0f, 0.0f};
+    Color throughput = {1.0f, 1.0f, 1.0f};
+    Ray ray = cameraRay;
 
-                Vector3 lightDir = (sampledPoint - hitPoint).normalize();
-                float lightDistance = (sampledPoint - hitPoint).length();
-                Ray shadowRay(hitPoint + normal * 1e-4, lightDir); // Offset to avoid self-intersection
+    // State of the previous vertex, needed to weight emitters hit by the BSDF sample
+    bool specularBounce = true; // Camera rays and delta lobes see emitters with full weight
+    float bsdfPdf = 0.0f;
+    Vector3 previousPoint = ray.origin;
 
-                if (!bvhRoot->trace(shadowRay, lightDistance, sampledPoint, normal, objectColor, reflectivity, transparency, refractiveIndex)) {
-                    float diff = std::max(0.0f, normal.dot(lightDir));
-                    lightContribution = lightContribution + sampledLight.color * diff * sampledLight.intensity / pdf;
-                }
+    for (int bounce = 0; bounce < depth; ++bounce) {
+        if (bounce > 0) {
+            STATS_ADD(SecondaryRays, 1);
+        }
+        HitRecord hit;
+        bool hitSurface = intersect(ray, std::numeric_limits<float>::max(), hit);
+
+        // Area lights reached by the sampled direction
+        const Light* emitter = nullptr;
+        float emitterDistance;
+        if (intersectLight(ray, hitSurface ? hit.distance : std::numeric_limits<float>::max(), emitter, emitterDistance)) {
+            Color emitted = emitter->color * emitter->intensity;
+            float weight = 1.0f;
+            if (!specularBounce) {
+                float lightPdf = lightSelectionProbability(previousPoint, *emitter) *
+                                 areaToSolidAngle(1.0f / (emitter->width * emitter->height), emitterDistance, emitter->normal, ray.direction);
+                weight = powerHeuristic(bsdfPdf, lightPdf);
             }
-
-            // Average the contribution from all light samples
-            finalColor = finalColor + lightContribution / numLightSamples;
+            radiance += throughput * emitted * weight;
+            break;
         }
 
-        // **Diffuse Reflection with BRDF Sampling**
-        Vector3 diffuseDir = randomHemisphereDirection(normal);
-        Ray diffuseRay(hitPoint + normal * 1e-4, diffuseDir);
-        Color diffuseColor = traceRayWithBRDF(diffuseRay, depth - 1) * objectColor;
-
-        // **Specular Reflection**
-        Vector3 reflectionDir = ray.direction - 2 * ray.direction.dot(normal) * normal;
-        reflectionDir = reflectionDir.normalize();
-        Ray reflectedRay(hitPoint + normal * 1e-4, reflectionDir);
-        Color specularColor = traceRayWithBRDF(reflectedRay, depth - 1) * reflectivity;
+        if (!hitSurface) {
+            break; // Background color
+        }
 
-        // **Refraction**
-        Color refractionColor = {0.0f, 0.0f, 0.0f};
-        if (transparency > 0.0f) {
-            float eta = 1.0f / refractiveIndex; // Assume air refractive index = 1
-            float cosTheta = -normal.dot(ray.direction);
-            float k = 1 - eta * eta * (1 - cosTheta * cosTheta);
+        const Material &material = *hit.material;
+        Vector3 normal = hit.normal;
+        float cosTheta = -normal.dot(ray.direction);
+        bool entering = cosTheta > 0.0f;
+        if (!entering) {
+            // Shade the side facing the ray
+            normal = -normal;
+            cosTheta = -cosTheta;
+        }
 
-            if (k >= 0.0f) {
-                Vector3 refractionDir = eta * ray.direction + (eta * cosTheta - std::sqrt(k)) * normal;
-                refractionDir = refractionDir.normalize();
-                Ray refractedRay(hitPoint + refractionDir * 1e-4, refractionDir);
-                refractionColor = traceRayWithBRDF(refractedRay, depth - 1) * transparency;
+        // Lobe weights: Fresnel-weighted mirror reflection, refraction and diffuse
+        float fresnel = 0.0f;
+        if (material.reflectivity > 0.0f || material.transparency > 0.0f) {
+            fresnel = material.reflectivity + (1.0f - material.reflectivity) * std::pow(1.0f - cosTheta, 5);
+        }
+        float specularWeight = fresnel;
+        float transmissionWeight = material.transparency * (1.0f - fresnel);
+        float diffuseWeight = std::max(0.0f, 1.0f - material.reflectivity - material.transparency) * (1.0f - fresnel);
+        float totalWeight = specularWeight + transmissionWeight + diffuseWeight;
+        float diffuseProbability = totalWeight > 0.0f ? diffuseWeight / totalWeight : 0.0f;
+
+        // **Next-Event Estimation**: one light sample for the diffuse lobe
+        LightSample lightSample;
+        if (sampleLight(hit.point, sampler, lightSample) && diffuseWeight > 0.0f) {
+            Vector3 toLight = lightSample.point - hit.point;
+            float lightDistance = toLight.length();
+            Vector3 lightDir = toLight / lightDistance;
+            float cosSurface = normal.dot(lightDir);
+
+            if (cosSurface > 0.0f) {
+                Ray shadowRay = spawnRay(hit, lightDir);
+                STATS_ADD(ShadowRays, 1);
+                if (!occluded(shadowRay, lightDistance)) {
+                    const Light &light = *lightSample.light;
+                    Color brdf = hit.color * (diffuseWeight / static_cast<float>(M_PI));
+                    Color emitted = light.color * light.intensity;
+
+                    if (light.areaLight) {
+                        float lightPdf = areaToSolidAngle(lightSample.pdf, lightDistance, light.normal, lightDir);
+                        if (lightPdf > 0.0f) {
+                            float scatterPdf = diffuseProbability * cosSurface / static_cast<float>(M_PI);
+                            float weight = powerHeuristic(lightPdf, scatterPdf);
+                            radiance += throughput * brdf * emitted * (cosSurface * weight / lightPdf);
+                        }
+                    } else {
+                        // Point lights can only be reached by light sampling
+                        float falloff = 1.0f / (lightDistance * lightDistance);
+                        radiance += throughput * brdf * emitted * (cosSurface * falloff / lightSample.pdf);
+                    }
+                }
             }
         }
 
-        // **Fresnel Effect**
-        float fresnel = reflectivity + (1.0f - reflectivity) * std::pow(1.0f - std::abs(normal.dot(-ray.direction)), 5);
+        // **BSDF Sampling**: pick a lobe in proportion to its weight
+        float lobeSample = sampler.get1D();
+        float directionU, directionV;
+        sampler.get2D(directionU, directionV);
 
-        // Combine all components: diffuse, specular, refraction, and light sampling
-        finalColor = finalColor * (1.0f - reflectivity - transparency) +
-                     diffuseColor * (1.0f - fresnel) +
-                     specularColor * fresnel +
-                     refractionColor;
+        if (totalWeight <= 0.0f) {
+            break;
+        }
 
-        return finalColor;
+        previousPoint = hit.point;
+        lobeSample *= totalWeight;
+
+        if (lobeSample < diffuseWeight) {
+            // Cosine-weighted diffuse bounce
+            Vector3 direction = cosineHemisphereDirection(normal, directionU, directionV);
+            bsdfPdf = diffuseProbability * std::max(0.0f, normal.dot(direction)) / static_cast<float>(M_PI);
+            specularBounce = false;
+            throughput = throughput * hit.color * totalWeight;
+            ray = spawnRay(hit, direction);
+        } else if (lobeSample < diffuseWeight + specularWeight) {
+            // **Specular Reflection**
+            Vector3 reflectionDir = ray.direction + 2 * cosTheta * normal;
+            specularBounce = true;
+            throughput = throughput * totalWeight;
+            Ray reflected = spawnRay(hit, reflectionDir);
+            transferDifferentials(ray, hit, reflected, [&](const Vector3 &d) { return reflect(d, normal); });
+            ray = reflected;
+        } else {
+            // **Refraction**
+            float eta = entering ? 1.0f / material.refractiveIndex : material.refractiveIndex; // Assume air refractive index = 1
+            Vector3 direction = refract(ray.direction, normal, eta); // Mirrored on total internal reflection
+            specularBounce = true;
+            throughput = throughput * totalWeight;
+            Ray refracted = spawnRay(hit, direction);
+            transferDifferentials(ray, hit, refracted, [&](const Vector3 &d) { return refract(d, normal, eta); });
+            ray = refracted;
+        }
     }
 
-    return {0.0f, 0.0f, 0.0f}; // Background color
+    return radiance;
 }
 
-Vector3 Scene::randomHemisphereDirection(const Vector3& normal) const {
-    std::mt19937 generator(std::random_device{}());
-    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
-
-    float u = dist(generator);
-    float v = dist(generator);
-
-    float theta = std::acos(std::sqrt(1.0f - u)); // Angle from the normal
-    float phi = 2.0f * M_PI * v;                 // Full rotation around the normal
-
-    float x = std::sin(theta) * std::cos(phi);
-    float y = std::sin(theta) * std::sin(phi);
-    float z = std::cos(theta);
+// Cosine-weighted direction about the normal
+Vector3 Scene::cosineHemisphereDirection(const Vector3& normal, float u, float v) const {
+    float r = std::sqrt(u);
+    float phi = 2.0f * M_PI * v;
 
-    Vector3 randomDir = {x, y, z};
-    if (randomDir.dot(normal) < 0.0f) {
-        randomDir = -randomDir; // Ensure it's in the correct hemisphere
-    }
+    // Orthonormal basis around the normal
+    Vector3 tangent = std::abs(normal.x) > 0.9f ? Vector3(0, 1, 0).cross(normal) : Vector3(1, 0, 0).cross(normal);
+    tangent = tangent.normalize();
+    Vector3 bitangent = normal.cross(tangent);
 
-    return randomDir;
+    float x = r * std::cos(phi);
+    float y = r * std::sin(phi);
+    float z = std::sqrt(std::max(0.0f, 1.0f - u));
+    return (tangent * x + bitangent * y + normal * z).normalize();
 }
 
-Light Scene::sampleLight(const Vector3& surfacePoint, Vector3& sampledPoint, float& pdf) const {
-    if (lights.empty()) {
-        throw std::runtime_error("No lights in the scene!");
+bool Scene::sampleLight(const Vector3& surfacePoint, Sampler& sampler, LightSample& sample) const {
+    // Consume the light dimensions up front so the layout does not depend on the light type
+    float lightSample = sampler.get1D();
+    float s, t;
+    sampler.get2D(s, t);
+
+    size_t lightIndex;
+    float selectionPmf;
+    if (!lightSampler || !lightSampler->sample(surfacePoint, lightSample, lightIndex, selectionPmf)) {
+        return false;
     }
 
-    std::mt19937 generator(std::random_device{}());
-    std::uniform_int_distribution<size_t> lightDist(0, lights.size() - 1);
-    const Light& light = lights[lightDist(generator)];
+    const Light& light = lights[lightIndex];
+    sample.light = &light;
 
     if (!light.areaLight) {
         // Handle point lights
-        sampledPoint = light.position;
-        pdf = 1.0f; // Point light sampling has uniform probability
-        return light;
+        sample.point = light.position;
+        sample.pdf = selectionPmf;
+        return true;
     }
 
     // Handle area lights
@@ -273,78 +522,185 @@ Light Scene::sampleLight(const Vector3& surfacePoint, Vector3& sampledPoint, flo
         throw std::runtime_error("Invalid area light dimensions!");
     }
 
-    Vector3 u = light.u.normalize() * light.width;
-    Vector3 v = light.v.normalize() * light.height;
+    // Uniform sampling over the area
+    sample.point = light.position + light.u * (light.width * (s - 0.5f)) + light.v * (light.height * (t - 0.5f));
+    sample.pdf = selectionPmf / (light.width * light.height);
+    return true;
+}
 
-    std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
-    sampledPoint = light.position + u * dist(generator) + v * dist(generator);
+float Scene::lightSelectionProbability(const Vector3& surfacePoint, const Light& light) const {
+    return lightSampler ? lightSampler->pmf(surfacePoint, static_cast<size_t>(&light - lights.data())) : 0.0f;
+}
 
-    // Ensure the sampled point is above the surface point (facing the same direction as the light normal)
-    if ((sampledPoint - surfacePoint).dot(light.normal) <= 0.0f) {
-        sampledPoint = light.position - u * dist(generator) - v * dist(generator);
+// Closest area light along the ray; area lights emit from both faces
+bool Scene::intersectLight(const Ray &ray, float maxDistance, const Light*& light, float& distance) const {
+    size_t lightIndex;
+    if (lightBVH && lightBVH->intersect(ray, maxDistance, lightIndex, distance)) {
+        light = &lights[lightIndex];
+        return true;
     }
-
-    // Calculate PDF for uniform sampling over the area
-    float area = light.width * light.height;
-    pdf = 1.0f / area;
-
-    return light;
+    return false;
 }
 
 // Load scene from JSON
 void Scene::loadFromJson(const std::string &filename) {
     std::ifstream file(filename);
-    json sceneJson;
-    file >> sceneJson;
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    json sceneJson = json::parse(text);
 
-    auto cameraConfig = sceneJson["camera"];
-    Vector3 position = {cameraConfig["position"][0], cameraConfig["position"][1], cameraConfig["position"][2]};
-    Vector3 lookAt = {cameraConfig["look_at"][0], cameraConfig["look_at"][1], cameraConfig["look_at"][2]};
-    Vector3 up = {cameraConfig["up"][0], cameraConfig["up"][1], cameraConfig["up"][2]};
-    float fov = cameraConfig["fov"];
-    int width = cameraConfig["width"];
-    int height = cameraConfig["height"];
-    int aperture = cameraConfig["aperture"];
-    int focusDistance = cameraConfig["focus_distance"];
+    // FNV-1a of the file as parsed
+    uint64_t hash = 14695981039346656037ull;
+    for (char byte : text) {
+        hash = (hash ^ static_cast<unsigned char>(byte)) * 1099511628211ull;
+    }
+    char digest[17];
+    std::snprintf(digest, sizeof(digest), "%016llx", static_cast<unsigned long long>(hash));
+    source = filename + " " + digest;
+
+    auto parseCamera = [](const json &cameraConfig) {
+        Vector3 position = {cameraConfig["position"][0], cameraConfig["position"][1], cameraConfig["position"][2]};
+        Vector3 lookAt = {cameraConfig["look_at"][0], cameraConfig["look_at"][1], cameraConfig["look_at"][2]};
+        Vector3 up = {cameraConfig["up"][0], cameraConfig["up"][1], cameraConfig["up"][2]};
+        float fov = cameraConfig["fov"];
+        int width = cameraConfig["width"];
+        int height = cameraConfig["height"];
+        float aperture = cameraConfig["aperture"];
+        float focusDistance = cameraConfig["focus_distance"];
+        return Camera(position, lookAt, up, fov, width, height, aperture, focusDistance);
+    };
+
+    json cameraConfig = sceneJson["camera"];
+    camera = new Camera(parseCamera(cameraConfig));
+
+    // Sequence cameras, from a list of views and/or a keyframed path. Keys an entry
+    // leaves out are taken from "camera".
+    if (sceneJson.contains("cameras")) {
+        for (const auto &view : sceneJson["cameras"]) {
+            json merged = cameraConfig;
+            merged.update(view);
+            sequenceCameras.push_back(parseCamera(merged));
+        }
+    }
+
+    if (sceneJson.contains("camera_path")) {
+        const json &path = sceneJson["camera_path"];
+        std::vector<json> keyframes = path["keyframes"];
+        if (keyframes.empty()) {
+            throw std::runtime_error("camera_path needs at least one keyframe");
+        }
+        std::stable_sort(keyframes.begin(), keyframes.end(), [](const json &a, const json &b) {
+            return a.value("frame", 0) < b.value("frame", 0);
+        });
+
+        // Numbers and vectors are interpolated linearly between the surrounding
+        // keyframes, everything else holds the earlier keyframe's value
+        auto interpolate = [](const json &a, const json &b, float t) {
+            if (a.is_number() && b.is_number()) {
+                return json(a.get<float>() + (b.get<float>() - a.get<float>()) * t);
+            }
+            if (a.is_array() && b.is_array() && a.size() == b.size()) {
+                json result = json::array();
+                for (size_t i = 0; i < a.size(); ++i) {
+                    result.push_back(a[i].get<float>() + (b[i].get<float>() - a[i].get<float>()) * t);
+                }
+                return result;
+            }
+            return a;
+        };
+
+        int frames = path.value("frames", keyframes.back().value("frame", 0) + 1);
+        size_t next = 0;
+        for (int frame = 0; frame < frames; ++frame) {
+            while (next < keyframes.size() && keyframes[next].value("frame", 0) <= frame) {
+                ++next;
+            }
+            const json &before = keyframes[next > 0 ? next - 1 : 0];
+            const json &after = keyframes[std::min(next, keyframes.size() - 1)];
 
-    camera = new Camera(position, lookAt, up, fov, width, height, aperture, focusDistance);
+            int span = after.value("frame", 0) - before.value("frame", 0);
+            float t = span > 0 ? static_cast<float>(frame - before.value("frame", 0)) / span : 0.0f;
 
-    for (const auto &object : sceneJson["objects"]) {
-        std::string type = object["type"];
-        Texture* texture = nullptr;
+            json merged = cameraConfig;
+            for (const auto &item : before.items()) {
+                if (item.key() == "frame") continue;
+                merged[item.key()] = after.contains(item.key()) ? interpolate(item.value(), after[item.key()], t) : item.value();
+            }
+            sequenceCameras.push_back(parseCamera(merged));
+        }
+    }
 
+    // Add a material from its description, shared by the "materials" section and inline
+    // object materials; its texture arrives with finishLoading()
+    auto addParsedMaterial = [this](const json &description, const std::string &name) {
+        Material material;
+        material.color = {description["color"][0], description["color"][1], description["color"][2]};
+        material.reflectivity = description.value("reflectivity", 0.0f);
+        material.transparency = description.value("transparency", 0.0f);
+        material.refractiveIndex = description.value("refractive_index", 1.0f);
+        MaterialId id = addMaterial(material, name);
+        if (description.contains("texture")) {
+            requestTexture(id, description["texture"]);
+        }
+        return id;
+    };
+
+    if (sceneJson.contains("materials")) {
+        for (const auto &description : sceneJson["materials"]) {
+            addParsedMaterial(description, description["name"]);
+        }
+    }
+
+    // Objects without a "material" reference share one table entry per distinct inline description
+    std::unordered_map<std::string, MaterialId> inlineMaterials;
+    auto resolveMaterial = [&](const json &object) -> MaterialId {
+        if (object.contains("material")) {
+            std::string name = object["material"];
+            auto it = materialNames.find(name);
+            if (it == materialNames.end()) {
+                throw std::runtime_error("Unknown material: " + name);
+            }
+            return it->second;
+        }
+
+        json description = {
+            {"color", object["color"]},
+            {"reflectivity", object.value("reflectivity", 0.0f)},
+            {"transparency", object.value("transparency", 0.0f)},
+            {"refractive_index", object.value("refractive_index", 1.0f)}
+        };
         if (object.contains("texture")) {
-            std::string textureFile = object["texture"];
-            texture = new Texture(textureFile);
+            description["texture"] = object["texture"];
+        }
+
+        std::string key = description.dump();
+        auto it = inlineMaterials.find(key);
+        if (it != inlineMaterials.end()) {
+            return it->second;
         }
+        MaterialId id = addParsedMaterial(description, "");
+        inlineMaterials[key] = id;
+        return id;
+    };
+
+    for (const auto &object : sceneJson["objects"]) {
+        std::string type = object["type"];
+        MaterialId materialId = resolveMaterial(object);
 
         if (type == "sphere") {
             Vector3 center = {object["center"][0], object["center"][1], object["center"][2]};
             float radius = object["radius"];
-            Color color = {object["color"][0], object["color"][1], object["color"][2]};
-            float reflectivity = object["reflectivity"];
-            float transparency = object["transparency"];
-            float refractiveIndex = object["refractive_index"];
-            addSphere(center, radius, color, reflectivity, transparency, refractiveIndex, texture);
+            addSphere(center, radius, materialId);
         } else if (type == "triangle") {
             Vector3 v0 = {object["v0"][0], object["v0"][1], object["v0"][2]};
             Vector3 v1 = {object["v1"][0], object["v1"][1], object["v1"][2]};
             Vector3 v2 = {object["v2"][0], object["v2"][1], object["v2"][2]};
-            Color color = {object["color"][0], object["color"][1], object["color"][2]};
-            float reflectivity = object["reflectivity"];
-            float transparency = object["transparency"];
-            float refractiveIndex = object["refractive_index"];
-            addTriangle(v0, v1, v2, color, reflectivity, transparency, refractiveIndex, texture);
+            addTriangle(v0, v1, v2, materialId);
         } else if (type == "cylinder") {
             Vector3 center = {object["center"][0], object["center"][1], object["center"][2]};
             Vector3 axis = {object["axis"][0], object["axis"][1], object["axis"][2]};
             float radius = object["radius"];
             float height = object["height"];
-            Color color = {object["color"][0], object["color"][1], object["color"][2]};
-            float reflectivity = object["reflectivity"];
-            float transparency = object["transparency"];
-            float refractiveIndex = object["refractive_index"];
-            addCylinder(center, axis, radius, height, color, reflectivity, transparency, refractiveIndex, texture);
+            addCylinder(center, axis, radius, height, materialId);
         }
     }
 
@@ -363,12 +719,7 @@ void Scene::loadFromJson(const std::string &filename) {
             float height = light["height"];
             float intensity = light["intensity"];
             Color color = {light["color"][0], light["color"][1], light["color"][2]};
-            Vector3 u = normal.cross(Vector3(0, 0, 1)).normalize(); // Cross with an arbitrary vector
-            if (u.length() == 0) {
-                u = normal.cross(Vector3(0, 1, 0)).normalize(); // Handle edge case where normal aligns with z-axis
-            }
-            Vector3 v = normal.cross(u).normalize();
-            lights.push_back({position, intensity, color, true, normal, width, height, u, v}); // `true` for area light
+            addLight(position, intensity, color, true, normal, width, height);
         }
     }
 }
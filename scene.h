@@ -10,43 +10,114 @@
 #include "camera.h"
 #include "color.h"
 #include "texture.h"
+#include "material.h"
+#include "light.h"
+#include "lightsampler.h"
 #include "bvhnode.h"
-#include <random>
+#include "sampler.h"
+#include "threadpool.h"
+#include <future>
+#include <memory>
+#include <unordered_map>
 
-struct Light {
-    Vector3 position;
-    float intensity;
-    Color color;
-    bool areaLight;
+struct HitRecord {
+    float distance;
+    Vector3 point;
+    float error;     // Bound on the rounding error of point
     Vector3 normal;
-    float width, height;
-    Vector3 u, v;
+    Color color;
+    const Material* material;
+    const BVHNode::Primitive* primitive;
+    // Where the ray's differentials meet the tangent plane, relative to point
+    bool hasDifferentials;
+    Vector3 dpdx, dpdy;
+};
+
+// Ray leaving a hit point in `direction`: its origin is moved off the surface past the
+// point's error bound, and a flat primitive is excluded from its intersection tests
+inline Ray spawnRay(const HitRecord &hit, const Vector3 &direction) {
+    Ray ray(offsetRayOrigin(hit.point, hit.error, hit.normal, direction), direction);
+    if (hit.primitive->isFlat()) {
+        ray.excluded = hit.primitive->object;
+    }
+    return ray;
+}
+
+struct LightSample {
+    const Light* light;
+    Vector3 point;
+    float pdf;       // Area density times the light selection probability; the probability alone for point lights
 };
 
 class Scene {
 public:
-    void addSphere(const Vector3 &center, float radius, const Color &color, float reflectivity = 0.0f, float transparency = 0.0f, float refractiveIndex = 1.0f, Texture* texture = nullptr);
-    void addTriangle(const Vector3 &v0, const Vector3 &v1, const Vector3 &v2, const Color &color, float reflectivity = 0.0f, float transparency = 0.0f, float refractiveIndex = 1.0f, Texture* texture = nullptr);
-    void addCylinder(const Vector3 &center, const Vector3 &axis, float radius, float height, const Color &color, float reflectivity = 0.0f, float transparency = 0.0f, float refractiveIndex = 1.0f, Texture* texture = nullptr);
+    Scene() = default;
+    ~Scene();
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    MaterialId addMaterial(const Material &material, const std::string &name = "");
+    const Material& getMaterial(MaterialId id) const { return materials[id]; }
+    // Points the material at a texture, which starts loading on a loader thread unless
+    // it was already requested; the material is untextured until finishLoading()
+    void requestTexture(MaterialId material, const std::string &filename);
+    // Waits for the requested textures and binds them to their materials. Materials
+    // whose texture failed to load keep their flat color.
+    void finishLoading();
+    // Storage format of textures requested from here on
+    void setTextureFormat(TextureFormat format) { textureFormat = format; }
+    void addSphere(const Vector3 &center, float radius, MaterialId materialId);
+    void addTriangle(const Vector3 &v0, const Vector3 &v1, const Vector3 &v2, MaterialId materialId);
+    void addCylinder(const Vector3 &center, const Vector3 &axis, float radius, float height, MaterialId materialId);
     void addLight(const Vector3 &position, float intensity, const Color &color, 
               bool areaLight = false, const Vector3 &normal = {0, -1, 0}, 
               float width = 0.0f, float height = 0.0f);
     void buildBVH();
+    // Takes effect at the next buildBVH if the light hierarchy is not built yet
+    void setLightSampler(const std::string &name);
     bool traceRay(const Ray &ray) const;
+    bool intersect(const Ray &ray, float maxDistance, HitRecord &hit) const;
+    // Any surface before maxDistance
+    bool occluded(const Ray &ray, float maxDistance) const;
+    // Light passing along the ray up to maxDistance, found in one traversal: transparent
+    // surfaces filter it by colour and transparency, opaque ones block it
+    Color transmittance(const Ray &ray, float maxDistance) const;
     Color traceRayWithShading(const Ray &ray, int depth = 3) const;
-    Color traceRayWithBRDF(const Ray &ray, int depth = 3) const;
-    Light sampleLight(const Vector3& surfacePoint, Vector3& sampledPoint, float& pdf) const;
+    Color traceRayWithBRDF(const Ray &ray, Sampler &sampler, int depth = 3) const;
+    bool sampleLight(const Vector3& surfacePoint, Sampler& sampler, LightSample& sample) const;
+    float lightSelectionProbability(const Vector3& surfacePoint, const Light& light) const;
+    bool intersectLight(const Ray &ray, float maxDistance, const Light*& light, float& distance) const;
+    // Textures keep loading after this returns; call finishLoading() before rendering
     void loadFromJson(const std::string &filename);
+    // Path of the loaded scene file and a hash of its contents when it was read, which
+    // together identify what a render is of; empty for scenes built in code
+    const std::string& getSource() const { return source; }
     Camera* getCamera() const { return camera; }
+    // Frames of a sequence render, empty unless the scene lists "cameras" or a "camera_path"
+    const std::vector<Camera>& getSequenceCameras() const { return sequenceCameras; }
 
 private:
     std::vector<Sphere*> spheres;
     std::vector<Triangle*> triangles;
     std::vector<Cylinder*> cylinders;
     std::vector<Light> lights;
+    std::vector<Material> materials;
+    std::unordered_map<std::string, MaterialId> materialNames;
+    std::unordered_map<std::string, std::unique_ptr<Texture>> textures;
+    TextureFormat textureFormat = TextureFormat::Float;
+    std::unordered_map<std::string, std::future<std::unique_ptr<Texture>>> pendingTextures;
+    std::vector<std::pair<MaterialId, std::string>> textureBindings;
+    std::unique_ptr<ThreadPool> loaderPool; // Created by the first request, released by finishLoading
+    std::string source;
     Camera* camera = nullptr;
+    std::vector<Camera> sequenceCameras;
     std::unique_ptr<BVHNode> bvhRoot = nullptr;
-    Vector3 randomHemisphereDirection(const Vector3& normal) const;
+    // Both point into `lights`, so adding a light drops them until the next buildBVH;
+    // the "bvh" sampler is the same tree that intersectLight uses
+    std::shared_ptr<const LightBVH> lightBVH;
+    std::shared_ptr<const LightSampler> lightSampler;
+    std::string lightSamplerName = "power";
+    Vector3 cosineHemisphereDirection(const Vector3& normal, float u, float v) const;
 };
 
 #endif
@@ -0,0 +1,298 @@
+// Procedural scene generator for scaling benchmarks. Writes a scene JSON with the
+// requested numbers of spheres, cylinders, triangle meshes and lights, placed with
+// one of several distributions, plus any textures it references.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    long spheres = 1000;
+    long cylinders = 0;
+    long meshes = 0;
+    long meshTriangles = 1000;
+    long lights = 1;
+    float areaLightFraction = 0.0f;
+    long textures = 0;
+    float texturedFraction = 0.0f;
+    std::string distribution = "uniform";
+    unsigned seed = 1;
+    int width = 320;
+    int height = 240;
+    std::string output = "generated.json";
+};
+
+struct Point {
+    float x, y, z;
+};
+
+// Object positions inside a cube of half-size `extent`, sized with the object
+// count so the density stays the same across scales:
+//   uniform    independent uniform positions
+//   clustered  normal-distributed around one centre per thousand objects
+//   grid       a regular lattice
+//   overlap    everything within a small ball, the worst case for any BVH
+class Placement {
+public:
+    Placement(const std::string& distribution, long count, float extent, std::mt19937& rng)
+        : distribution(distribution), extent(extent), rng(rng) {
+        if (distribution == "clustered") {
+            std::uniform_real_distribution<float> position(-extent, extent);
+            long clusters = std::max(1L, count / 1000);
+            for (long i = 0; i < clusters; ++i) {
+                centers.push_back({position(rng), position(rng), position(rng)});
+            }
+        } else if (distribution == "grid") {
+            side = std::max(1L, static_cast<long>(std::ceil(std::cbrt(static_cast<double>(count)))));
+        } else if (distribution != "uniform" && distribution != "overlap") {
+            throw std::runtime_error("Unknown distribution: " + distribution);
+        }
+    }
+
+    Point next() {
+        if (distribution == "clustered") {
+            std::uniform_int_distribution<size_t> pick(0, centers.size() - 1);
+            std::normal_distribution<float> spread(0.0f, extent * 0.05f);
+            const Point& c = centers[pick(rng)];
+            return {c.x + spread(rng), c.y + spread(rng), c.z + spread(rng)};
+        }
+        if (distribution == "grid") {
+            long i = index++;
+            float step = 2.0f * extent / side;
+            return {-extent + step * (i % side + 0.5f), -extent + step * ((i / side) % side + 0.5f),
+                    -extent + step * ((i / (side * side)) % side + 0.5f)};
+        }
+
+        float range = distribution == "overlap" ? extent * 0.1f : extent;
+        std::uniform_real_distribution<float> position(-range, range);
+        return {position(rng), position(rng), position(rng)};
+    }
+
+private:
+    std::string distribution;
+    float extent;
+    std::mt19937& rng;
+    std::vector<Point> centers;
+    long side = 1;
+    long index = 0;
+};
+
+void writeTexture(const std::string& filename, int variant) {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("Failed to open file: " + filename);
+    }
+
+    const int size = 256;
+    out << "P6\n" << size << " " << size << "\n255\n";
+    unsigned char a[3] = {static_cast<unsigned char>(60 + 50 * (variant % 4)), 90, static_cast<unsigned char>(200 - 30 * (variant % 5))};
+    unsigned char b[3] = {230, 230, 220};
+    int checker = 8 + 8 * (variant % 3);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            out.write(reinterpret_cast<const char*>(((x / checker + y / checker) % 2) ? a : b), 3);
+        }
+    }
+}
+
+void printUsage() {
+    std::cerr << "Usage: ./scenegen [options]\n"
+              << "  --spheres <n>              Spheres (default: 1000)\n"
+              << "  --cylinders <n>            Cylinders (default: 0)\n"
+              << "  --meshes <n>               Tessellated sphere meshes (default: 0)\n"
+              << "  --mesh-triangles <n>       Triangles per mesh (default: 1000)\n"
+              << "  --lights <n>               Lights (default: 1)\n"
+              << "  --area-lights <fraction>   Fraction of lights that are area lights (default: 0)\n"
+              << "  --textures <n>             Checker textures to generate (default: 0)\n"
+              << "  --textured <fraction>      Fraction of objects using a texture (default: 0)\n"
+              << "  --distribution <name>      uniform, clustered, grid or overlap (default: uniform)\n"
+              << "  --seed <n>                 Random seed (default: 1)\n"
+              << "  --size <width> <height>    Image size (default: 320 240)\n"
+              << "  -o <file>                  Output scene (default: generated.json)\n";
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (option == "--spheres" && hasValue) {
+            options.spheres = std::stol(argv[++i]);
+        } else if (option == "--cylinders" && hasValue) {
+            options.cylinders = std::stol(argv[++i]);
+        } else if (option == "--meshes" && hasValue) {
+            options.meshes = std::stol(argv[++i]);
+        } else if (option == "--mesh-triangles" && hasValue) {
+            options.meshTriangles = std::max(8L, std::stol(argv[++i]));
+        } else if (option == "--lights" && hasValue) {
+            options.lights = std::stol(argv[++i]);
+        } else if (option == "--area-lights" && hasValue) {
+            options.areaLightFraction = std::stof(argv[++i]);
+        } else if (option == "--textures" && hasValue) {
+            options.textures = std::stol(argv[++i]);
+        } else if (option == "--textured" && hasValue) {
+            options.texturedFraction = std::stof(argv[++i]);
+        } else if (option == "--distribution" && hasValue) {
+            options.distribution = argv[++i];
+        } else if (option == "--seed" && hasValue) {
+            options.seed = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (option == "--size" && i + 2 < argc) {
+            options.width = std::stoi(argv[++i]);
+            options.height = std::stoi(argv[++i]);
+        } else if (option == "-o" && hasValue) {
+            options.output = argv[++i];
+        } else {
+            throw std::runtime_error("Unknown option: " + option);
+        }
+    }
+    return options;
+}
+
+// Streams the scene: a DOM for millions of objects would dwarf the renderer's own memory
+void generate(const Options& options) {
+    std::mt19937 rng(options.seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    long objectCount = options.spheres + options.cylinders + options.meshes * options.meshTriangles / 100;
+    float extent = std::max(2.0f, std::cbrt(static_cast<float>(std::max(1L, objectCount))) * 2.0f);
+
+    std::FILE* out = std::fopen(options.output.c_str(), "w");
+    if (!out) {
+        throw std::runtime_error("Failed to open file: " + options.output);
+    }
+
+    // Textures are written next to the scene and referenced by that same path
+    std::string stem = options.output.substr(0, options.output.rfind('.'));
+    std::vector<std::string> textureFiles;
+    for (long i = 0; i < options.textures; ++i) {
+        textureFiles.push_back(stem + "_texture" + std::to_string(i) + ".ppm");
+        writeTexture(textureFiles.back(), static_cast<int>(i));
+    }
+
+    // The camera takes its field of view in radians and writes rows bottom-up, hence the flipped up vector
+    std::fprintf(out, "{\n  \"camera\": {\"position\": [0, %g, %g], \"look_at\": [0, -0.35, -1], \"up\": [0, -1, 0], "
+                      "\"fov\": 1.0, \"width\": %d, \"height\": %d, \"aperture\": 0, \"focus_distance\": %g},\n",
+                 extent * 0.8f, extent * 2.5f, options.width, options.height, extent * 2.5f);
+
+    // A small palette of shared materials keeps the file compact
+    const int Palette = 8;
+    std::fprintf(out, "  \"materials\": [\n");
+    for (int i = 0; i < Palette; ++i) {
+        std::fprintf(out, "    {\"name\": \"diffuse%d\", \"color\": [%.3f, %.3f, %.3f]},\n", i,
+                     0.2f + 0.8f * unit(rng), 0.2f + 0.8f * unit(rng), 0.2f + 0.8f * unit(rng));
+    }
+    for (size_t i = 0; i < textureFiles.size(); ++i) {
+        std::fprintf(out, "    {\"name\": \"textured%zu\", \"color\": [1, 1, 1], \"texture\": \"%s\"},\n", i, textureFiles[i].c_str());
+    }
+    std::fprintf(out, "    {\"name\": \"mirror\", \"color\": [0.9, 0.9, 0.9], \"reflectivity\": 0.8},\n"
+                      "    {\"name\": \"glass\", \"color\": [1, 1, 1], \"reflectivity\": 0.05, \"transparency\": 0.9, \"refractive_index\": 1.5}\n"
+                      "  ],\n");
+
+    auto material = [&]() -> std::string {
+        if (!textureFiles.empty() && unit(rng) < options.texturedFraction) {
+            return "textured" + std::to_string(static_cast<size_t>(unit(rng) * textureFiles.size()) % textureFiles.size());
+        }
+        float pick = unit(rng);
+        if (pick < 0.05f) return "mirror";
+        if (pick < 0.08f) return "glass";
+        return "diffuse" + std::to_string(static_cast<int>(unit(rng) * Palette) % Palette);
+    };
+
+    std::fprintf(out, "  \"lights\": [\n");
+    Placement lightPlacement(options.distribution == "overlap" ? "uniform" : options.distribution,
+                             options.lights, extent, rng);
+    // Total emitted power stays roughly constant as the light count grows
+    float pointIntensity = 1.5f / std::max(1L, options.lights);
+    float areaSize = extent * 0.3f;
+    float areaIntensity = 150.0f * extent * extent / (16.0f * areaSize * areaSize) / std::max(1L, options.lights);
+    for (long i = 0; i < options.lights; ++i) {
+        Point p = lightPlacement.next();
+        p.y = std::abs(p.y) + extent * 1.2f;
+        const char* separator = i + 1 < options.lights ? "," : "";
+        if (unit(rng) < options.areaLightFraction) {
+            std::fprintf(out, "    {\"type\": \"area\", \"position\": [%g, %g, %g], \"normal\": [0, -1, 0], \"width\": %g, "
+                              "\"height\": %g, \"intensity\": %g, \"color\": [1, 1, 1]}%s\n",
+                         p.x, p.y, p.z, areaSize, areaSize, areaIntensity, separator);
+        } else {
+            std::fprintf(out, "    {\"type\": \"point\", \"position\": [%g, %g, %g], \"intensity\": %g, \"color\": [1, 1, 1]}%s\n",
+                         p.x, p.y, p.z, pointIntensity, separator);
+        }
+    }
+    std::fprintf(out, "  ],\n  \"objects\": [\n");
+
+    // Ground plane below the objects
+    float ground = -extent * 1.1f, size = extent * 4.0f;
+    std::fprintf(out, "    {\"type\": \"triangle\", \"v0\": [%g, %g, %g], \"v1\": [%g, %g, %g], \"v2\": [%g, %g, %g], \"material\": \"diffuse0\"},\n",
+                 -size, ground, -size, -size, ground, size, size, ground, size);
+    std::fprintf(out, "    {\"type\": \"triangle\", \"v0\": [%g, %g, %g], \"v1\": [%g, %g, %g], \"v2\": [%g, %g, %g], \"material\": \"diffuse0\"}",
+                 -size, ground, -size, size, ground, size, size, ground, -size);
+
+    bool overlap = options.distribution == "overlap";
+    Placement placement(options.distribution, options.spheres + options.cylinders + options.meshes, extent, rng);
+
+    for (long i = 0; i < options.spheres; ++i) {
+        Point p = placement.next();
+        float radius = (overlap ? extent * 0.2f : 0.3f) + 0.5f * unit(rng);
+        std::fprintf(out, ",\n    {\"type\": \"sphere\", \"center\": [%g, %g, %g], \"radius\": %g, \"material\": \"%s\"}",
+                     p.x, p.y, p.z, radius, material().c_str());
+    }
+
+    for (long i = 0; i < options.cylinders; ++i) {
+        Point p = placement.next();
+        float radius = (overlap ? extent * 0.1f : 0.2f) + 0.3f * unit(rng);
+        std::fprintf(out, ",\n    {\"type\": \"cylinder\", \"center\": [%g, %g, %g], \"axis\": [%g, %g, %g], \"radius\": %g, "
+                          "\"height\": %g, \"material\": \"%s\"}",
+                     p.x, p.y, p.z, unit(rng) - 0.5f, unit(rng), unit(rng) - 0.5f, radius, 0.5f + 1.5f * unit(rng),
+                     material().c_str());
+    }
+
+    // UV spheres with about meshTriangles triangles each
+    int rings = std::max(2, static_cast<int>(std::sqrt(options.meshTriangles / 2.0)));
+    int segments = std::max(3, static_cast<int>(options.meshTriangles / (2 * rings)));
+    for (long m = 0; m < options.meshes; ++m) {
+        Point c = placement.next();
+        float radius = overlap ? extent * 0.3f : 1.0f + unit(rng);
+        std::string meshMaterial = material();
+        auto vertex = [&](int ring, int segment) {
+            float theta = static_cast<float>(M_PI) * ring / rings;
+            float phi = 2.0f * static_cast<float>(M_PI) * segment / segments;
+            return Point{c.x + radius * std::sin(theta) * std::cos(phi), c.y + radius * std::cos(theta),
+                         c.z + radius * std::sin(theta) * std::sin(phi)};
+        };
+        for (int ring = 0; ring < rings; ++ring) {
+            for (int segment = 0; segment < segments; ++segment) {
+                Point a = vertex(ring, segment), b = vertex(ring + 1, segment);
+                Point d = vertex(ring + 1, segment + 1), e = vertex(ring, segment + 1);
+                std::fprintf(out, ",\n    {\"type\": \"triangle\", \"v0\": [%g, %g, %g], \"v1\": [%g, %g, %g], \"v2\": [%g, %g, %g], \"material\": \"%s\"}",
+                             a.x, a.y, a.z, b.x, b.y, b.z, d.x, d.y, d.z, meshMaterial.c_str());
+                std::fprintf(out, ",\n    {\"type\": \"triangle\", \"v0\": [%g, %g, %g], \"v1\": [%g, %g, %g], \"v2\": [%g, %g, %g], \"material\": \"%s\"}",
+                             a.x, a.y, a.z, d.x, d.y, d.z, e.x, e.y, e.z, meshMaterial.c_str());
+            }
+        }
+    }
+
+    std::fprintf(out, "\n  ]\n}\n");
+    if (std::fclose(out) != 0) {
+        throw std::runtime_error("Failed to write " + options.output);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        generate(parseOptions(argc, argv));
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        printUsage();
+        return 1;
+    }
+    return 0;
+}
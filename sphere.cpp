@@ -2,11 +2,8 @@
 #include "boundingbox.h"
 #include <cmath>
 
-Sphere::Sphere(const Vector3 &center, float radius, const Color &color, 
-               float reflectivity, float transparency, float refractiveIndex, 
-               Texture* texture)
-    : center(center), radius(radius), color(color), reflectivity(reflectivity), 
-      transparency(transparency), refractiveIndex(refractiveIndex), texture(texture) {}
+Sphere::Sphere(const Vector3 &center, float radius, MaterialId materialId)
+    : center(center), radius(radius), materialId(materialId) {}
 
 bool Sphere::doesIntersect(const Ray &ray) const {
     Vector3 oc = ray.origin - center;
@@ -22,7 +19,7 @@ bool Sphere::doesIntersect(const Ray &ray) const {
     float t1 = (-b - std::sqrt(discriminant)) / (2.0f * a);
     float t2 = (-b + std::sqrt(discriminant)) / (2.0f * a);
 
-    return (t1 > 1e-6f || t2 > 1e-6f);
+    return (t1 > ray.tMin || t2 > ray.tMin);
 }
 
 float Sphere::getIntersectionDistance(const Ray &ray) const {
@@ -35,38 +32,34 @@ float Sphere::getIntersectionDistance(const Ray &ray) const {
         return -1.0f; // No intersection
     }
     float t = (-b - std::sqrt(discriminant)) / (2.0f * a);
-    if (t > 1e-6f) {
+    if (t > ray.tMin) {
         return t;
     }
     t = (-b + std::sqrt(discriminant)) / (2.0f * a);
-    return t > 1e-6f ? t : -1.0f;
+    return t > ray.tMin ? t : -1.0f;
 }
 
 Vector3 Sphere::getCenter() const {
     return center;
 }
 
-Color Sphere::getColor(const Vector3 &hitPoint) const {
-    if (texture) {
-        Vector3 normal = (hitPoint - center).normalize();
-        float u = 0.5f + std::atan2(normal.z, normal.x) / (2.0f * M_PI);
-        float v = 0.5f - std::asin(normal.y) / M_PI;
-
-        return texture->getColorAt(u, v);
-    }
-    return color;
+Vector3 Sphere::getNormal(const Vector3 &point) const {
+    return (point - center).normalize();
 }
 
-float Sphere::getReflectivity() const {
-    return reflectivity;
+Vector3 Sphere::projectToSurface(const Vector3 &point) const {
+    Vector3 offset = point - center;
+    return center + offset * (radius / offset.length());
 }
 
-float Sphere::getTransparency() const {
-    return transparency;
+void Sphere::getTextureCoordinates(const Vector3 &hitPoint, float &u, float &v) const {
+    Vector3 normal = (hitPoint - center).normalize();
+    u = 0.5f + std::atan2(normal.z, normal.x) / (2.0f * M_PI);
+    v = 0.5f - std::asin(normal.y) / M_PI;
 }
 
-float Sphere::getRefractiveIndex() const {
-    return refractiveIndex;
+MaterialId Sphere::getMaterialId() const {
+    return materialId;
 }
 
 BoundingBox Sphere::getBoundingBox() const {
@@ -3,33 +3,27 @@
 
 #include "vector3.h"
 #include "ray.h"
-#include "color.h"
-#include "texture.h"
+#include "material.h"
 #include "boundingbox.h"
 
 class Sphere {
 public:
-    Sphere(const Vector3 &center, float radius, const Color &color,
-           float reflectivity = 0.0f, float transparency = 0.0f,
-           float refractiveIndex = 1.0f, Texture* texture = nullptr);
+    Sphere(const Vector3 &center, float radius, MaterialId materialId = 0);
 
     bool doesIntersect(const Ray &ray) const;
     float getIntersectionDistance(const Ray &ray) const;
     Vector3 getCenter() const;
-    Color getColor(const Vector3& hitPoint) const;
-    float getReflectivity() const;
-    float getTransparency() const;
-    float getRefractiveIndex() const;
+    Vector3 getNormal(const Vector3 &point) const;
+    // Nearest point on the sphere, removing the rounding error of a computed hit point
+    Vector3 projectToSurface(const Vector3 &point) const;
+    void getTextureCoordinates(const Vector3 &hitPoint, float &u, float &v) const;
+    MaterialId getMaterialId() const;
     BoundingBox getBoundingBox() const;
 
 private:
     Vector3 center;
     float radius;
-    Color color;
-    float reflectivity;
-    float transparency;
-    float refractiveIndex;
-    Texture* texture;
+    MaterialId materialId;
 };
 
 #endif
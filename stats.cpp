@@ -0,0 +1,136 @@
+#include "stats.h"
+#include "json.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include <sys/resource.h>
+
+using json = nlohmann::json;
+
+namespace stats {
+
+namespace {
+
+const char* CounterNames[CounterCount] = {
+    "camera_rays", "secondary_rays", "shadow_rays", "bvh_node_visits", "primitive_tests",
+    "texture_cache_hits", "texture_cache_misses", "texture_cache_evictions",
+    "texture_bytes"
+};
+
+const char* PhaseNames[PhaseCount] = {
+    "parse", "texture_load", "bvh_build", "render", "denoise", "output"
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<const ThreadCounters*> live;
+    uint64_t retired[CounterCount] = {};
+    std::atomic<int64_t> phaseNanoseconds[PhaseCount] = {};
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+// Lives as long as the thread that registered
+struct Registration {
+    Registration() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.live.push_back(&threadCounters);
+    }
+
+    ~Registration() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (int i = 0; i < CounterCount; ++i) {
+            r.retired[i] += threadCounters.values[i].load(std::memory_order_relaxed);
+        }
+        r.live.erase(std::find(r.live.begin(), r.live.end(), &threadCounters));
+    }
+};
+
+} // namespace
+
+void registerThread() {
+    thread_local Registration registration;
+    threadCounters.registered = true;
+}
+
+void addPhaseTime(Phase phase, std::chrono::steady_clock::duration duration) {
+    registry().phaseNanoseconds[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+}
+
+Summary collect() {
+    Summary summary;
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (int i = 0; i < CounterCount; ++i) {
+        summary.counters[i] = r.retired[i];
+        for (const ThreadCounters* counters : r.live) {
+            summary.counters[i] += counters->values[i].load(std::memory_order_relaxed);
+        }
+    }
+    for (int i = 0; i < PhaseCount; ++i) {
+        summary.phaseSeconds[i] = r.phaseNanoseconds[i].load() * 1e-9;
+    }
+
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        summary.peakMemoryMB = usage.ru_maxrss / 1024.0; // reported in kilobytes on Linux
+    }
+    return summary;
+}
+
+void printSummary(std::ostream& out, const Summary& summary) {
+    double renderSeconds = summary.phaseSeconds[Render];
+    uint64_t rays = summary.totalRays();
+
+    out << "Statistics:\n";
+    for (int i = 0; i < PhaseCount; ++i) {
+        out << "  " << std::left << std::setw(24) << PhaseNames[i] << std::right << std::fixed
+            << std::setprecision(3) << summary.phaseSeconds[i] << " s\n";
+    }
+    for (int i = 0; i < CounterCount; ++i) {
+        out << "  " << std::left << std::setw(24) << CounterNames[i] << std::right << summary.counters[i] << "\n";
+    }
+    if (rays > 0) {
+        out << "  " << std::left << std::setw(24) << "nodes_per_ray" << std::right << std::setprecision(2)
+            << static_cast<double>(summary.counters[BVHNodeVisits]) / rays << "\n";
+        out << "  " << std::left << std::setw(24) << "tests_per_ray" << std::right
+            << static_cast<double>(summary.counters[PrimitiveTests]) / rays << "\n";
+    }
+    if (renderSeconds > 0.0) {
+        out << "  " << std::left << std::setw(24) << "mrays_per_second" << std::right << std::setprecision(3)
+            << rays / renderSeconds * 1e-6 << "\n";
+    }
+    out << "  " << std::left << std::setw(24) << "peak_memory" << std::right << std::setprecision(1)
+        << summary.peakMemoryMB << " MB\n";
+    out << std::defaultfloat;
+}
+
+void writeJson(const std::string& filename, const Summary& summary) {
+    json result;
+    for (int i = 0; i < PhaseCount; ++i) {
+        result["phases"][PhaseNames[i]] = summary.phaseSeconds[i];
+    }
+    for (int i = 0; i < CounterCount; ++i) {
+        result["counters"][CounterNames[i]] = summary.counters[i];
+    }
+    result["rays"] = summary.totalRays();
+    double renderSeconds = summary.phaseSeconds[Render];
+    result["mrays_per_second"] = renderSeconds > 0.0 ? summary.totalRays() / renderSeconds * 1e-6 : 0.0;
+    result["peak_memory_mb"] = summary.peakMemoryMB;
+
+    std::ofstream out(filename);
+    if (!out) {
+        throw std::runtime_error("Failed to open file: " + filename);
+    }
+    out << result.dump(2) << "\n";
+}
+
+} // namespace stats
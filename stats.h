@@ -0,0 +1,102 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Render statistics: event counters kept per thread and merged when reported, plus
+// wall-clock phase timers. Building with -DRAYTRACER_NO_STATS compiles the
+// STATS_ADD and STATS_PHASE hooks out entirely.
+namespace stats {
+
+enum Counter {
+    CameraRays,
+    SecondaryRays,  // Reflection, refraction and path tracing bounces
+    ShadowRays,
+    BVHNodeVisits,
+    PrimitiveTests,
+    TextureCacheHits,
+    TextureCacheMisses,
+    TextureCacheEvictions,
+    TextureBytes, // Resident texel storage of loaded textures
+    CounterCount
+};
+
+enum Phase {
+    Parse,
+    TextureLoad, // Part of Parse
+    BVHBuild,
+    Render,
+    Denoise, // AOV pass and filtering
+    Output,
+    PhaseCount
+};
+
+// Counters of one thread. Only the owning thread writes them, so increments are
+// plain relaxed load/store pairs; the atomics only make reads from other threads
+// safe. The struct is trivial so the thread_local needs no initialisation guard.
+struct ThreadCounters {
+    std::atomic<uint64_t> values[CounterCount];
+    bool registered;
+};
+
+inline thread_local ThreadCounters threadCounters;
+
+// Makes the calling thread's counters visible to collect() and folds them into
+// the process totals when the thread exits
+void registerThread();
+
+inline void add(Counter counter, uint64_t amount) {
+    if (!threadCounters.registered) {
+        registerThread();
+    }
+    std::atomic<uint64_t>& value = threadCounters.values[counter];
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+// Current value of one of the calling thread's counters; the difference of two
+// readings is the work the thread did in between
+inline uint64_t threadValue(Counter counter) {
+    return threadCounters.values[counter].load(std::memory_order_relaxed);
+}
+
+void addPhaseTime(Phase phase, std::chrono::steady_clock::duration duration);
+
+// Adds the lifetime of the scope to a phase
+class ScopedPhase {
+public:
+    explicit ScopedPhase(Phase phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+    ~ScopedPhase() { addPhaseTime(phase, std::chrono::steady_clock::now() - start); }
+
+private:
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+struct Summary {
+    uint64_t counters[CounterCount] = {};
+    double phaseSeconds[PhaseCount] = {};
+    double peakMemoryMB = 0.0; // resident set high-water mark of the process
+
+    uint64_t totalRays() const { return counters[CameraRays] + counters[SecondaryRays] + counters[ShadowRays]; }
+};
+
+// Totals of exited threads plus the current values of live ones
+Summary collect();
+void printSummary(std::ostream& out, const Summary& summary);
+void writeJson(const std::string& filename, const Summary& summary);
+
+} // namespace stats
+
+#ifndef RAYTRACER_NO_STATS
+#define STATS_ADD(counter, amount) stats::add(stats::counter, amount)
+#define STATS_PHASE(phase) stats::ScopedPhase statsPhaseTimer(stats::phase)
+#else
+#define STATS_ADD(counter, amount) ((void)0)
+#define STATS_PHASE(phase) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,518 @@
+// Regression tests for behaviour that has to stay exactly reproducible.
+// Build and run with `make test`; `./raytracer_tests <filter>` runs only the
+// tests whose name contains the filter.
+#include "camera.h"
+#include "checkpoint.h"
+#include "lightsampler.h"
+#include "renderfarm.h"
+#include "sampler.h"
+#include "scene.h"
+#include "texture.h"
+#include "textureformat.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+void check(bool passed, const char* expression, const char* file, int line) {
+    if (!passed) {
+        ++failures;
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+    }
+}
+
+// Sampler sequences
+
+// Values are a pure function of (seed, pixel, sample, dimension), whatever was drawn before
+void testSamplerReproducible() {
+    for (const char* name : {"random", "halton", "sobol"}) {
+        auto sampler = createSampler(name, 16, 7);
+        std::vector<float> first;
+        sampler->startPixelSample(3, 5, 2);
+        for (int i = 0; i < 8; ++i) {
+            first.push_back(sampler->get1D());
+        }
+
+        sampler->startPixelSample(4, 5, 9);
+        sampler->get1D();
+        sampler->startPixelSample(3, 5, 2);
+        for (int i = 0; i < 8; ++i) {
+            float value = sampler->get1D();
+            CHECK(value == first[i]);
+            CHECK(value >= 0.0f && value < 1.0f);
+        }
+
+        auto other = createSampler(name, 16, 8);
+        other->startPixelSample(3, 5, 2);
+        CHECK(other->get1D() != first[0]);
+    }
+}
+
+// Pinned values: a change here silently invalidates checkpoints and mixes farm renders
+void testSamplerSequences() {
+    const std::pair<const char*, std::vector<float>> expected[] = {
+        {"random", {0x1.0a9a56p-1f, 0x1.d0360ap-1f, 0x1.be07a2p-1f, 0x1.b97ccep-1f}},
+        {"halton", {0x1.be0cb8p-2f, 0x1.dfffp-3f, 0x1.45c64p-2f, 0x1.df9304p-6f}},
+        {"sobol", {0x1.09c35cp-3f, 0x1.d566d2p-1f, 0x1.b25d88p-1f, 0x1.d3798ap-2f}},
+    };
+    for (const auto& [name, values] : expected) {
+        auto sampler = createSampler(name, 16, 7);
+        sampler->startPixelSample(3, 5, 2);
+        for (float value : values) {
+            CHECK(sampler->get1D() == value);
+        }
+    }
+}
+
+// Cell of each sample in a grid of the given size
+std::set<int> strata(const std::vector<float>& u, const std::vector<float>& v, int columns, int rows) {
+    std::set<int> cells;
+    for (size_t i = 0; i < u.size(); ++i) {
+        cells.insert(static_cast<int>(v[i] * rows) * columns + static_cast<int>(u[i] * columns));
+    }
+    return cells;
+}
+
+// Scrambling keeps the stratification: the 16 Sobol samples of a pixel cover every
+// elementary interval of area 1/16 once, in each 2D dimension pair
+void testSobolStratification() {
+    const int samples = 16;
+    SobolSampler sampler(samples, 3);
+    for (int dimension = 0; dimension < 4; ++dimension) {
+        std::vector<float> u, v;
+        for (int i = 0; i < samples; ++i) {
+            sampler.startPixelSample(10, 20, i);
+            float a, b;
+            for (int skip = 0; skip < dimension; ++skip) {
+                sampler.get2D(a, b);
+            }
+            sampler.get2D(a, b);
+            u.push_back(a);
+            v.push_back(b);
+        }
+        for (int columns = 1; columns <= samples; columns *= 2) {
+            CHECK(strata(u, v, columns, samples / columns).size() == static_cast<size_t>(samples));
+        }
+    }
+}
+
+// The first base^k Halton samples put one value in each interval of width 1/base^k
+void testHaltonStratification() {
+    HaltonSampler sampler(5);
+    const int counts[] = {16, 27, 25}; // Bases 2, 3 and 5
+    for (int dimension = 0; dimension < 3; ++dimension) {
+        std::vector<float> values, zeros;
+        for (int i = 0; i < counts[dimension]; ++i) {
+            sampler.startPixelSample(1, 2, i);
+            for (int skip = 0; skip < dimension; ++skip) {
+                sampler.get1D();
+            }
+            values.push_back(sampler.get1D());
+            zeros.push_back(0.0f);
+        }
+        CHECK(strata(values, zeros, counts[dimension], 1).size() == static_cast<size_t>(counts[dimension]));
+    }
+}
+
+// Light selection
+
+Light pointLight(const Vector3& position, float intensity) {
+    return {position, intensity, Color(1, 1, 1), false, Vector3(0, -1, 0), 0.0f, 0.0f, {}, {}};
+}
+
+// How often each light is picked over evenly spaced u in [0, 1)
+std::vector<double> selectionFrequencies(const LightSampler& sampler, const Vector3& point, size_t lightCount) {
+    const int samples = 100000;
+    std::vector<double> frequencies(lightCount, 0.0);
+    for (int i = 0; i < samples; ++i) {
+        size_t lightIndex;
+        float pmf;
+        float u = (i + 0.5f) / samples;
+        if (sampler.sample(point, u, lightIndex, pmf)) {
+            CHECK(lightIndex < lightCount);
+            CHECK(pmf == sampler.pmf(point, lightIndex));
+            frequencies[lightIndex] += 1.0 / samples;
+        }
+    }
+    return frequencies;
+}
+
+// The alias table picks lights in proportion to power, and never one without power
+void testAliasTableProbabilities() {
+    const float intensities[] = {1.0f, 2.0f, 3.0f, 10.0f, 0.0f, 0.5f};
+    std::vector<Light> lights;
+    float total = 0.0f;
+    for (float intensity : intensities) {
+        lights.push_back(pointLight(Vector3(intensity, 0, 0), intensity));
+        total += intensity;
+    }
+
+    PowerLightSampler sampler(lights);
+    std::vector<double> frequencies = selectionFrequencies(sampler, Vector3(), lights.size());
+    for (size_t i = 0; i < lights.size(); ++i) {
+        float expected = intensities[i] / total;
+        CHECK(std::abs(sampler.pmf(Vector3(), i) - expected) < 1e-6f);
+        CHECK(std::abs(frequencies[i] - expected) < 1e-3);
+    }
+    CHECK(frequencies[4] == 0.0);
+
+    // Without emitted power every light is equally likely
+    std::vector<Light> dark(4, pointLight(Vector3(), 0.0f));
+    PowerLightSampler uniform(dark);
+    for (double frequency : selectionFrequencies(uniform, Vector3(), dark.size())) {
+        CHECK(std::abs(frequency - 0.25) < 1e-3);
+    }
+}
+
+// The light BVH reports the probability it actually samples with, summing to one
+void testLightBVHProbabilities() {
+    std::vector<Light> lights;
+    for (int i = 0; i < 13; ++i) {
+        lights.push_back(pointLight(Vector3(static_cast<float>(i % 4) * 3, static_cast<float>(i / 4) * 2, 1), 1.0f + i));
+    }
+    LightBVH tree(lights);
+
+    const Vector3 points[] = {Vector3(0, 0, 0), Vector3(4, 3, 1), Vector3(-20, 5, 2)};
+    for (const Vector3& point : points) {
+        std::vector<double> frequencies = selectionFrequencies(tree, point, lights.size());
+        float sum = 0.0f;
+        for (size_t i = 0; i < lights.size(); ++i) {
+            float pmf = tree.pmf(point, i);
+            sum += pmf;
+            CHECK(std::abs(frequencies[i] - pmf) < 1e-3);
+        }
+        CHECK(std::abs(sum - 1.0f) < 1e-5f);
+    }
+}
+
+// Texture formats
+
+// Encodes packed RGB texels and decodes them again
+std::vector<Color> roundTrip(TextureFormat format, const std::vector<float>& rgb, int width, int height) {
+    std::vector<unsigned char> encoded(textureBytes(format, width, height));
+    encodeTexture(format, rgb.data(), width, height, encoded.data());
+    std::vector<Color> decoded;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            decoded.push_back(decodeTexel(format, encoded.data(), width, x, y));
+        }
+    }
+    return decoded;
+}
+
+float maxError(const std::vector<Color>& decoded, const std::vector<float>& rgb) {
+    float error = 0.0f;
+    for (size_t i = 0; i < decoded.size(); ++i) {
+        error = std::max({error, std::abs(decoded[i].r - rgb[3 * i]), std::abs(decoded[i].g - rgb[3 * i + 1]),
+                          std::abs(decoded[i].b - rgb[3 * i + 2])});
+    }
+    return error;
+}
+
+// Half floats keep representable values exactly, round to nearest even and saturate to infinity
+void testHalfRoundTrip() {
+    const std::vector<float> exact = {0.0f, 1.0f, -2.0f, 0.5f, 65504.0f, 0x1p-14f, 0x1p-24f, -0x1.8p-20f, 1.0f + 0x1p-10f};
+    std::vector<Color> decoded = roundTrip(TextureFormat::FP16, exact, static_cast<int>(exact.size() / 3), 1);
+    CHECK(maxError(decoded, exact) == 0.0f);
+
+    // Ties go to the even mantissa, anything past the largest half becomes infinity
+    const std::vector<float> rounded = {1.0f + 0x1p-11f, 1.0f + 0x3p-11f, 70000.0f};
+    decoded = roundTrip(TextureFormat::FP16, rounded, 1, 1);
+    CHECK(decoded[0].r == 1.0f);
+    CHECK(decoded[0].g == 1.0f + 0x1p-9f);
+    CHECK(std::isinf(decoded[0].b) && decoded[0].b > 0.0f);
+
+    // Elsewhere in the normal range the relative error stays within half an ulp
+    std::vector<float> values;
+    for (int i = 0; i < 3 * 1000; ++i) {
+        values.push_back(std::ldexp(1.0f + (i % 997) / 997.0f, i % 30 - 14) * (i % 2 ? 1.0f : -1.0f));
+    }
+    decoded = roundTrip(TextureFormat::FP16, values, 1000, 1);
+    for (size_t i = 0; i < decoded.size(); ++i) {
+        const float channels[3] = {decoded[i].r, decoded[i].g, decoded[i].b};
+        for (int c = 0; c < 3; ++c) {
+            CHECK(std::abs(channels[c] - values[3 * i + c]) <= std::abs(values[3 * i + c]) * 0x1p-11f);
+        }
+    }
+}
+
+// 8-bit formats are exact for 8-bit values
+void testByteRoundTrip() {
+    std::vector<float> values;
+    for (int i = 0; i < 3 * 256; ++i) {
+        values.push_back((i * 7 % 256) / 255.0f);
+    }
+    CHECK(maxError(roundTrip(TextureFormat::RGBA8, values, 16, 16), values) == 0.0f);
+    CHECK(maxError(roundTrip(TextureFormat::RGB8, values, 16, 16), values) == 0.0f);
+}
+
+// BC1 reproduces blocks made of its own palette exactly and stays close on smooth images
+void testBC1RoundTrip() {
+    using textureformat::unpack565;
+    const uint16_t first = (31 << 11) | (40 << 5) | 8, second = (0 << 11) | (10 << 5) | 20;
+    std::vector<float> palette;
+    for (int i = 0; i < 16; ++i) {
+        const float* weights = textureformat::BC1Weights[1][(i * 5) % 4];
+        Color color = unpack565(first) * weights[0] + unpack565(second) * weights[1];
+        palette.insert(palette.end(), {color.r, color.g, color.b});
+    }
+    CHECK(maxError(roundTrip(TextureFormat::BC1, palette, 4, 4), palette) < 1e-6f);
+
+    Color flat = unpack565(second);
+    std::vector<float> flatBlock;
+    for (int i = 0; i < 16; ++i) {
+        flatBlock.insert(flatBlock.end(), {flat.r, flat.g, flat.b});
+    }
+    CHECK(maxError(roundTrip(TextureFormat::BC1, flatBlock, 4, 4), flatBlock) == 0.0f);
+
+    // A colour ramp along a line in RGB. Edge blocks of an image that is not a multiple
+    // of four repeat the last row and column.
+    const int width = 13, height = 7;
+    CHECK(textureBytes(TextureFormat::BC1, width, height) == 8 * 4 * 2);
+    std::vector<float> gradient;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            float t = (x + 0.25f * y) / width;
+            gradient.insert(gradient.end(), {t, 1.0f - t, 0.5f * t});
+        }
+    }
+    // Blocks span about 0.29 of the ramp: half a palette step plus the 565 rounding
+    CHECK(maxError(roundTrip(TextureFormat::BC1, gradient, width, height), gradient) < 0.07f);
+}
+
+// Odd-sized mip levels keep their last row and column: the single-texel level of a
+// texture is its mean, however bright the edge
+void testMipmapMean() {
+    const int sizes[][2] = {{3, 3}, {5, 4}, {7, 1}};
+    for (const auto& size : sizes) {
+        int width = size[0], height = size[1];
+        char path[] = "/tmp/raytracer_tests_XXXXXX";
+        int fd = mkstemp(path);
+        if (fd >= 0) close(fd);
+
+        double mean[3] = {};
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << "P6\n" << width << " " << height << "\n255\n";
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    unsigned char rgb[3] = {static_cast<unsigned char>(x == width - 1 ? 255 : 10),
+                                            static_cast<unsigned char>(20 * y), static_cast<unsigned char>(30 * x)};
+                    out.write(reinterpret_cast<const char*>(rgb), 3);
+                    for (int c = 0; c < 3; ++c) {
+                        mean[c] += rgb[c] / 255.0f / (width * height);
+                    }
+                }
+            }
+        }
+
+        Texture texture(path);
+        std::remove(path);
+        CHECK(texture.isLoaded());
+        // A footprint far larger than the texture selects the last level
+        Color coarsest = texture.getColorAt(0.5f, 0.5f, 100.0f, 0.0f, 0.0f, 100.0f);
+        CHECK(std::abs(coarsest.r - mean[0]) < 1e-5);
+        CHECK(std::abs(coarsest.g - mean[1]) < 1e-5);
+        CHECK(std::abs(coarsest.b - mean[2]) < 1e-5);
+    }
+}
+
+// Whole renders
+
+const char* TestScene = R"({
+    "camera": {"position": [0, 2, 6], "look_at": [0, -0.3, -1], "up": [0, 1, 0], "fov": 60,
+               "width": 40, "height": 30, "aperture": 0.0, "focus_distance": 1.0},
+    "lights": [{"type": "area", "position": [0, 6, 0], "intensity": 40, "color": [1, 1, 1],
+                "normal": [0, -1, 0], "width": 2, "height": 2},
+               {"type": "point", "position": [-3, 4, 3], "intensity": 2, "color": [1, 0.8, 0.6]}],
+    "objects": [
+        {"type": "sphere", "center": [-1, 0, -2], "radius": 1, "color": [0.8, 0.2, 0.2],
+         "reflectivity": 0.2, "transparency": 0.0, "refractive_index": 1.0},
+        {"type": "sphere", "center": [1.2, -0.3, -1], "radius": 0.7, "color": [0.9, 0.9, 0.9],
+         "reflectivity": 0.0, "transparency": 0.8, "refractive_index": 1.5},
+        {"type": "triangle", "v0": [-6, -1, 4], "v1": [6, -1, 4], "v2": [-6, -1, -8], "color": [0.6, 0.6, 0.6],
+         "reflectivity": 0.0, "transparency": 0.0, "refractive_index": 1.0},
+        {"type": "triangle", "v0": [6, -1, 4], "v1": [6, -1, -8], "v2": [-6, -1, -8], "color": [0.6, 0.6, 0.6],
+         "reflectivity": 0.0, "transparency": 0.0, "refractive_index": 1.0}
+    ]
+})";
+
+// Writes TestScene to a temporary file, removed again on destruction
+struct TestSceneFile {
+    std::string path;
+
+    TestSceneFile() {
+        char name[] = "/tmp/raytracer_tests_XXXXXX";
+        int fd = mkstemp(name);
+        if (fd >= 0) close(fd);
+        path = name;
+        std::ofstream(path) << TestScene;
+    }
+    ~TestSceneFile() { std::remove(path.c_str()); }
+};
+
+RenderSettings testSettings() {
+    RenderSettings settings;
+    settings.renderMode = "pathtracer";
+    settings.samplesPerPixel = 4;
+    settings.seed = 11;
+    settings.tileSize = 8;
+    return settings;
+}
+
+std::unique_ptr<Scene> loadScene(const std::string& path, const RenderSettings& settings) {
+    auto scene = std::make_unique<Scene>();
+    scene->setTextureFormat(parseTextureFormat(settings.textureFormat));
+    scene->loadFromJson(path);
+    scene->buildBVH();
+    scene->finishLoading();
+    scene->setLightSampler(settings.lightSamplerName);
+    return scene;
+}
+
+// Same colour sums and sample counts in every pixel
+bool sameImage(const Film& a, const Film& b) {
+    if (a.getWidth() != b.getWidth() || a.getHeight() != b.getHeight()) return false;
+    for (int y = 0; y < a.getHeight(); ++y) {
+        for (int x = 0; x < a.getWidth(); ++x) {
+            const FilmPixel& p = a.getPixelData(x, y);
+            const FilmPixel& q = b.getPixelData(x, y);
+            if (p.samples != q.samples || !std::equal(p.colorSum, p.colorSum + 3, q.colorSum)) return false;
+        }
+    }
+    return true;
+}
+
+// Stopping after some tiles and resuming from the checkpoint gives the uninterrupted render
+void testCheckpointResume() {
+    TestSceneFile sceneFile;
+    RenderSettings settings = testSettings();
+    settings.checkpointFile = sceneFile.path + ".checkpoint";
+    auto scene = loadScene(sceneFile.path, settings);
+    const Camera& camera = *scene->getCamera();
+    auto sampler = createSampler(settings.samplerName, settings.maxSamples(), settings.seed);
+
+    Film reference(camera.getWidth(), camera.getHeight());
+    camera.renderFilm(*scene, settings, *sampler, reference);
+    CHECK(reference.getTotalSamples() == 4LL * camera.getWidth() * camera.getHeight());
+    float brightest = 0.0f;
+    for (int y = 0; y < camera.getHeight(); ++y) {
+        for (int x = 0; x < camera.getWidth(); ++x) {
+            brightest = std::max(brightest, reference.getPixel(x, y).r);
+        }
+    }
+    CHECK(brightest > 0.0f);
+
+    Film partial(camera.getWidth(), camera.getHeight());
+    std::vector<Tile> tiles = partial.makeTiles(settings.tileSize);
+    size_t stop = tiles.size() / 2;
+    for (size_t i = 0; i < stop; ++i) {
+        camera.renderTile(*scene, settings, *sampler, tiles[i], 0, settings.maxSamples(), partial);
+    }
+    saveCheckpoint(settings.checkpointFile, scene->getSource(), settings, partial, stop);
+
+    Film resumed(camera.getWidth(), camera.getHeight());
+    size_t completedTiles = 0;
+    CHECK(loadCheckpoint(settings.checkpointFile, scene->getSource(), settings, resumed, completedTiles));
+    CHECK(completedTiles == stop);
+    CHECK(sameImage(resumed, partial));
+    for (size_t i = completedTiles; i < tiles.size(); ++i) {
+        camera.renderTile(*scene, settings, *sampler, tiles[i], 0, settings.maxSamples(), resumed);
+    }
+    CHECK(sameImage(resumed, reference));
+
+    // Another scene or other settings must not resume from it
+    auto rejects = [&](const std::string& source, const RenderSettings& other) {
+        Film film(camera.getWidth(), camera.getHeight());
+        try {
+            loadCheckpoint(settings.checkpointFile, source, other, film, completedTiles);
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    CHECK(rejects(scene->getSource() + "x", settings));
+    RenderSettings otherFormat = settings;
+    otherFormat.textureFormat = "bc1";
+    CHECK(rejects(scene->getSource(), otherFormat));
+    RenderSettings otherSeed = settings;
+    otherSeed.seed = 12;
+    CHECK(rejects(scene->getSource(), otherSeed));
+
+    std::remove(settings.checkpointFile.c_str());
+    CHECK(!loadCheckpoint(settings.checkpointFile, scene->getSource(), settings, resumed, completedTiles));
+}
+
+// Forked workers rendering tiles or sample ranges reproduce the local render bit for bit
+void testFarmMatchesLocal() {
+    TestSceneFile sceneFile;
+    for (const char* split : {"tiles", "samples"}) {
+        RenderSettings settings = testSettings();
+        settings.farmSplit = split;
+        auto scene = loadScene(sceneFile.path, settings);
+        const Camera& camera = *scene->getCamera();
+        auto sampler = createSampler(settings.samplerName, settings.maxSamples(), settings.seed);
+
+        Film local(camera.getWidth(), camera.getHeight());
+        camera.renderFilm(*scene, settings, *sampler, local);
+
+        Film farmed(camera.getWidth(), camera.getHeight());
+        RenderFarm farm(sceneFile.path, settings);
+        farm.spawnLocalWorkers(3);
+        farm.render(farmed);
+        CHECK(sameImage(farmed, local));
+    }
+}
+
+struct Test {
+    const char* name;
+    std::function<void()> run;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string filter = argc > 1 ? argv[1] : "";
+
+    const Test tests[] = {
+        {"sampler/reproducible", testSamplerReproducible},
+        {"sampler/sequences", testSamplerSequences},
+        {"sampler/sobol stratification", testSobolStratification},
+        {"sampler/halton stratification", testHaltonStratification},
+        {"lights/alias table", testAliasTableProbabilities},
+        {"lights/bvh probabilities", testLightBVHProbabilities},
+        {"textures/fp16 round trip", testHalfRoundTrip},
+        {"textures/8-bit round trip", testByteRoundTrip},
+        {"textures/bc1 round trip", testBC1RoundTrip},
+        {"textures/mipmap mean", testMipmapMean},
+        {"render/checkpoint resume", testCheckpointResume},
+        {"render/farm matches local", testFarmMatchesLocal},
+    };
+
+    int run = 0;
+    for (const Test& test : tests) {
+        if (std::string(test.name).find(filter) == std::string::npos) {
+            continue;
+        }
+        int before = failures;
+        test.run();
+        std::printf("%-36s %s\n", test.name, failures == before ? "ok" : "FAILED");
+        ++run;
+    }
+
+    std::printf("%d tests, %d failed checks\n", run, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -1,15 +1,99 @@
 #include "texture.h"
+#include "texturecache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
 
-Texture::Texture(const std::string& filePath) {
-    if (!loadTexture(filePath)) {
+namespace {
+
+// Tiled file: magic, version, tile size, texel format, level count and level sizes,
+// then every level's tiles row by row. Edge tiles are stored full size, padded with
+// their last row and column so block-compressed edges encode as they do resident.
+const char TiledMagic[4] = {'R', 'T', 'T', 'X'};
+const uint32_t TiledVersion = 3; // 3: box-filtered odd-sized levels
+const int TileSize = 64;
+
+bool isNewer(const std::string& path, const std::string& than) {
+    struct stat pathInfo, thanInfo;
+    return stat(path.c_str(), &pathInfo) == 0 && stat(than.c_str(), &thanInfo) == 0 &&
+           pathInfo.st_mtime >= thanInfo.st_mtime;
+}
+
+// Source texels under output texel i when sourceSize texels shrink to size: the texel
+// covers sourceSize / size of them, each weighted by its overlap. At most three taps
+// when size is sourceSize / 2 rounded down.
+int boxTaps(int sourceSize, int size, int i, int index[3], float weight[3]) {
+    // In units of 1 / size source texels, so overlaps are exact integers
+    long begin = static_cast<long>(i) * sourceSize, end = begin + sourceSize;
+    int count = 0;
+    for (int s = static_cast<int>(begin / size); s < sourceSize && static_cast<long>(s) * size < end; ++s) {
+        long overlap = std::min(end, static_cast<long>(s + 1) * size) - std::max(begin, static_cast<long>(s) * size);
+        index[count] = s;
+        weight[count] = static_cast<float>(overlap) / sourceSize;
+        ++count;
+    }
+    return count;
+}
+
+} // namespace
+
+Texture::Texture(const std::string& filePath, TextureFormat format) : format(format) {
+    TextureCache& cache = TextureCache::global();
+    std::string tiledPath = filePath + ".tiled";
+    if (cache.enabled() && isNewer(tiledPath, filePath) && openTiled(tiledPath)) {
+        return;
+    }
+
+    Image image;
+    if (!loadImage(filePath, image)) {
         std::cerr << "Failed to load texture: " << filePath << std::endl;
+        return;
+    }
+    std::vector<Image> pyramid = buildPyramid(std::move(image));
+
+    if (cache.enabled()) {
+        try {
+            writeTiled(tiledPath, pyramid);
+            if (openTiled(tiledPath)) {
+                return;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+        }
+        std::cerr << "Keeping texture resident: " << filePath << std::endl;
+    }
+
+    for (const Image& source : pyramid) {
+        Level level;
+        level.width = source.width;
+        level.height = source.height;
+        level.data.resize(textureBytes(format, level.width, level.height));
+        encodeTexture(format, source.rgb.data(), level.width, level.height, level.data.data());
+        levels.push_back(std::move(level));
     }
 }
 
-bool Texture::loadTexture(const std::string& filePath) {
+Texture::~Texture() {
+    if (tiledFile >= 0) {
+        TextureCache::global().closeFile(tiledFile);
+    }
+}
+
+size_t Texture::getMemoryBytes() const {
+    size_t bytes = 0;
+    for (const Level& level : levels) {
+        bytes += level.data.size();
+    }
+    return bytes;
+}
+
+bool Texture::loadImage(const std::string& filePath, Image& image) {
     std::ifstream file(filePath, std::ios::binary);
     if (!file.is_open()) {
         return false;
@@ -22,24 +106,194 @@ bool Texture::loadTexture(const std::string& filePath) {
         return false;
     }
 
-    file >> width >> height;
+    file >> image.width >> image.height;
     int maxColor;
     file >> maxColor;
     file.ignore();
+    if (!file || image.width <= 0 || image.height <= 0) {
+        return false;
+    }
 
-    data.resize(width * height);
+    image.rgb.resize(image.width * image.height * 3);
 
-    for (int i = 0; i < width * height; ++i) {
+    for (int i = 0; i < image.width * image.height; ++i) {
         unsigned char rgb[3];
         file.read(reinterpret_cast<char*>(rgb), 3);
-        data[i] = {rgb[0] / 255.0f, rgb[1] / 255.0f, rgb[2] / 255.0f};
+        image.rgb[3 * i] = rgb[0] / 255.0f;
+        image.rgb[3 * i + 1] = rgb[1] / 255.0f;
+        image.rgb[3 * i + 2] = rgb[2] / 255.0f;
     }
 
     return true;
 }
 
+// Each level halves the one above, down to a single texel. Odd sizes round down and
+// every texel box-filters its share of the texels above (three at 1/3 each when
+// shrinking 3 to 1), so edge texels count fully and each level keeps the mean of the
+// image. Filtering is done on the decoded floats, so smaller formats only round each
+// level once.
+std::vector<Texture::Image> Texture::buildPyramid(Image image) {
+    std::vector<Image> pyramid;
+    pyramid.push_back(std::move(image));
+    while (pyramid.back().width > 1 || pyramid.back().height > 1) {
+        const Image& source = pyramid.back();
+        Image level;
+        level.width = std::max(1, source.width / 2);
+        level.height = std::max(1, source.height / 2);
+        level.rgb.resize(level.width * level.height * 3);
+
+        for (int y = 0; y < level.height; ++y) {
+            int rows[3];
+            float rowWeights[3];
+            int rowCount = boxTaps(source.height, level.height, y, rows, rowWeights);
+            for (int x = 0; x < level.width; ++x) {
+                int columns[3];
+                float columnWeights[3];
+                int columnCount = boxTaps(source.width, level.width, x, columns, columnWeights);
+                float* texel = &level.rgb[3 * (y * level.width + x)];
+                for (int j = 0; j < rowCount; ++j) {
+                    for (int i = 0; i < columnCount; ++i) {
+                        const float* above = &source.rgb[3 * (rows[j] * source.width + columns[i])];
+                        float weight = rowWeights[j] * columnWeights[i];
+                        for (int c = 0; c < 3; ++c) {
+                            texel[c] += weight * above[c];
+                        }
+                    }
+                }
+            }
+        }
+        pyramid.push_back(std::move(level));
+    }
+    return pyramid;
+}
+
+// Written next to the target and renamed over it, so readers never see a partial file
+void Texture::writeTiled(const std::string& tiledPath, const std::vector<Image>& pyramid) const {
+    std::string temporary = tiledPath + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        if (!out) {
+            throw std::runtime_error("Failed to open file: " + temporary);
+        }
+
+        uint32_t header[4] = {TiledVersion, TileSize, static_cast<uint32_t>(format), static_cast<uint32_t>(pyramid.size())};
+        out.write(TiledMagic, sizeof(TiledMagic));
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        for (const Image& level : pyramid) {
+            int32_t size[2] = {level.width, level.height};
+            out.write(reinterpret_cast<const char*>(size), sizeof(size));
+        }
+
+        std::vector<float> tile(TileSize * TileSize * 3);
+        std::vector<unsigned char> encoded(textureBytes(format, TileSize, TileSize));
+        for (const Image& level : pyramid) {
+            for (int tileY = 0; tileY < level.height; tileY += TileSize) {
+                for (int tileX = 0; tileX < level.width; tileX += TileSize) {
+                    for (int y = 0; y < TileSize; ++y) {
+                        int sourceY = std::min(tileY + y, level.height - 1);
+                        for (int x = 0; x < TileSize; ++x) {
+                            int sourceX = std::min(tileX + x, level.width - 1);
+                            std::copy_n(&level.rgb[3 * (sourceY * level.width + sourceX)], 3, &tile[3 * (y * TileSize + x)]);
+                        }
+                    }
+                    encodeTexture(format, tile.data(), TileSize, TileSize, encoded.data());
+                    out.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+                }
+            }
+        }
+
+        if (!out) {
+            throw std::runtime_error("Failed to write file: " + temporary);
+        }
+    }
+
+    if (std::rename(temporary.c_str(), tiledPath.c_str()) != 0) {
+        throw std::runtime_error("Failed to replace file: " + tiledPath);
+    }
+}
+
+// Reads the level sizes; false if the file is not a tiled texture of this version
+// and format
+bool Texture::openTiled(const std::string& tiledPath) {
+    std::ifstream in(tiledPath, std::ios::binary);
+    char magic[4];
+    uint32_t header[4];
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!in || std::memcmp(magic, TiledMagic, sizeof(magic)) != 0 || header[0] != TiledVersion ||
+        header[1] != TileSize || header[2] != static_cast<uint32_t>(format) || header[3] == 0 || header[3] > 32) {
+        return false;
+    }
+
+    std::vector<Level> tiledLevels(header[3]);
+    uint32_t tiles = 0;
+    for (Level& level : tiledLevels) {
+        int32_t size[2];
+        in.read(reinterpret_cast<char*>(size), sizeof(size));
+        if (!in || size[0] <= 0 || size[1] <= 0) {
+            return false;
+        }
+        level.width = size[0];
+        level.height = size[1];
+        level.tilesX = (level.width + TileSize - 1) / TileSize;
+        level.firstTile = tiles;
+        tiles += level.tilesX * ((level.height + TileSize - 1) / TileSize);
+    }
+
+    tileDataOffset = sizeof(magic) + sizeof(header) + tiledLevels.size() * 2 * sizeof(int32_t);
+    tiledFile = TextureCache::global().openFile(tiledPath);
+    levels = std::move(tiledLevels);
+    return true;
+}
+
+Color Texture::bilinear(const Level& level, float u, float v) const {
+    float x = u * level.width - 0.5f;
+    float y = v * level.height - 0.5f;
+    float fx = std::floor(x), fy = std::floor(y);
+    float tx = x - fx, ty = y - fy;
+
+    auto wrap = [](int i, int size) { return ((i % size) + size) % size; };
+    int x0 = wrap(static_cast<int>(fx), level.width), x1 = wrap(x0 + 1, level.width);
+    int y0 = wrap(static_cast<int>(fy), level.height), y1 = wrap(y0 + 1, level.height);
+
+    auto blend = [&](auto texel) {
+        return (texel(x0, y0) * (1.0f - tx) + texel(x1, y0) * tx) * (1.0f - ty) +
+               (texel(x0, y1) * (1.0f - tx) + texel(x1, y1) * tx) * ty;
+    };
+
+    if (tiledFile < 0) {
+        return blend([&](int x, int y) { return decodeTexel(format, level.data.data(), level.width, x, y); });
+    }
+
+    // The four texels usually share a tile, which is then fetched once
+    size_t tileBytes = textureBytes(format, TileSize, TileSize);
+    TextureCache::Tile tile;
+    uint32_t tileIndex = UINT32_MAX;
+    return blend([&](int x, int y) {
+        uint32_t index = level.firstTile + (y / TileSize) * level.tilesX + x / TileSize;
+        if (index != tileIndex) {
+            tile = TextureCache::global().getTile(tiledFile, index, tileDataOffset + index * tileBytes, tileBytes);
+            tileIndex = index;
+        }
+        return decodeTexel(format, tile->data(), TileSize, x % TileSize, y % TileSize);
+    });
+}
+
 Color Texture::getColorAt(float u, float v) const {
-    int x = static_cast<int>(u * width) % width;
-    int y = static_cast<int>(v * height) % height;
-    return data[y * width + x];
+    return bilinear(levels[0], u, v);
+}
+
+Color Texture::getColorAt(float u, float v, float dudx, float dvdx, float dudy, float dvdy) const {
+    // Footprint size in full-resolution texels along its longer axis
+    float width = static_cast<float>(levels[0].width), height = static_cast<float>(levels[0].height);
+    float footprint = std::max(std::hypot(dudx * width, dvdx * height), std::hypot(dudy * width, dvdy * height));
+    float lod = std::clamp(std::log2(std::max(footprint, 1e-8f)), 0.0f, static_cast<float>(levels.size() - 1));
+
+    int level = static_cast<int>(lod);
+    float blend = lod - level;
+    Color color = bilinear(levels[level], u, v);
+    if (blend > 0.0f) {
+        color = color * (1.0f - blend) + bilinear(levels[level + 1], u, v) * blend;
+    }
+    return color;
 }
@@ -1,19 +1,57 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include "color.h"
+#include "textureformat.h"
 
+// Mip-mapped RGB texture with wrapping texture coordinates, stored in the given
+// format. While the global TextureCache has a budget, the pyramid lives in a tiled
+// file next to the image (reused while newer than it and in the same format) and its
+// tiles are read on demand through the cache.
 class Texture {
 public:
-    Texture(const std::string& filePath);
+    Texture(const std::string& filePath, TextureFormat format = TextureFormat::Float);
+    // Closes the tiled file, if any, dropping its tiles from the cache
+    ~Texture();
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
+    // Bilinear lookup in the full-resolution level
     Color getColorAt(float u, float v) const;
+    // Trilinear lookup for a footprint given by the texture coordinate derivatives
+    // across a pixel, choosing the pyramid levels whose texels match its size
+    Color getColorAt(float u, float v, float dudx, float dvdx, float dudy, float dvdy) const;
+    bool isLoaded() const { return !levels.empty(); }
+    TextureFormat getFormat() const { return format; }
+    // Bytes of texel storage held by the texture; tiles held by the cache are not counted
+    size_t getMemoryBytes() const;
 
 private:
-    int width, height;
-    std::vector<Color> data;
-    bool loadTexture(const std::string& filePath);
+    // Decoded RGB floats, three per texel, used while loading
+    struct Image {
+        int width, height;
+        std::vector<float> rgb;
+    };
+
+    struct Level {
+        int width, height;
+        std::vector<unsigned char> data; // Texels in the texture's format; empty when tiled
+        int tilesX = 0;
+        uint32_t firstTile = 0;          // Index of the level's first tile in the tiled file
+    };
+
+    TextureFormat format;
+    std::vector<Level> levels; // Full resolution first, each level half the previous one
+    int tiledFile = -1;        // TextureCache file id while the texels live in tiles
+    uint64_t tileDataOffset = 0;
+
+    static bool loadImage(const std::string& filePath, Image& image);
+    static std::vector<Image> buildPyramid(Image image);
+    bool openTiled(const std::string& tiledPath);
+    void writeTiled(const std::string& tiledPath, const std::vector<Image>& pyramid) const;
+    Color bilinear(const Level& level, float u, float v) const;
 };
 
 #endif
@@ -0,0 +1,150 @@
+#include "texturecache.h"
+#include "stats.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+
+TextureCache& TextureCache::global() {
+    static TextureCache instance;
+    return instance;
+}
+
+TextureCache::~TextureCache() {
+    for (const File& file : files) {
+        if (file.fd >= 0) {
+            ::close(file.fd);
+        }
+    }
+}
+
+void TextureCache::setBudget(size_t bytes) {
+    budget = bytes;
+}
+
+int TextureCache::openFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file: " + path + ": " + std::strerror(errno));
+    }
+    std::lock_guard<std::mutex> lock(fileMutex);
+    files.push_back({fd, path});
+    return static_cast<int>(files.size()) - 1;
+}
+
+void TextureCache::closeFile(int file) {
+    {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        File& entry = files.at(file);
+        if (entry.fd >= 0) {
+            ::close(entry.fd);
+            entry.fd = -1;
+        }
+    }
+
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+            if (static_cast<int>(it->first >> 32) == file) {
+                size_t size = it->second.tile->size();
+                shard.bytes -= size;
+                residentBytes -= size;
+                shard.recent.erase(it->second.position);
+                it = shard.entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+// Null when the read fails
+TextureCache::Tile TextureCache::readTile(int file, uint64_t offset, size_t size) {
+    int fd;
+    {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        fd = files.at(file).fd;
+    }
+    if (fd < 0) {
+        errno = EBADF;
+        return nullptr;
+    }
+
+    auto data = std::make_shared<std::vector<unsigned char>>(size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t received = ::pread(fd, data->data() + done, size - done, static_cast<off_t>(offset + done));
+        if (received < 0 && errno == EINTR) continue;
+        if (received < 0) {
+            return nullptr;
+        }
+        if (received == 0) {
+            errno = EIO; // The file ends before the tile
+            return nullptr;
+        }
+        done += static_cast<size_t>(received);
+    }
+    return data;
+}
+
+// Misses read the tile without holding the shard lock, so other threads keep hitting
+// meanwhile; if two threads miss on the same tile the second copy is dropped
+TextureCache::Tile TextureCache::getTile(int file, uint32_t index, uint64_t offset, size_t size) {
+    uint64_t key = (static_cast<uint64_t>(file) << 32) | index;
+    Shard& shard = shards[(key * 0x9E3779B97F4A7C15ull) >> 60];
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            shard.recent.splice(shard.recent.begin(), shard.recent, it->second.position);
+            STATS_ADD(TextureCacheHits, 1);
+            return it->second.tile;
+        }
+    }
+
+    STATS_ADD(TextureCacheMisses, 1);
+    Tile tile = readTile(file, offset, size);
+    if (!tile) {
+        // Render threads carry on with black texels rather than abort the frame
+        std::string error = std::strerror(errno);
+        std::lock_guard<std::mutex> lock(fileMutex);
+        File& entry = files.at(file);
+        if (!entry.failed) {
+            entry.failed = true;
+            std::cerr << "Failed to read texture tile: " << entry.path << ": " << error << std::endl;
+        }
+        return std::make_shared<std::vector<unsigned char>>(size);
+    }
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end()) {
+        return it->second.tile;
+    }
+
+    shard.recent.push_front(key);
+    shard.entries[key] = {tile, shard.recent.begin()};
+    shard.bytes += size;
+    residentBytes += size;
+
+    // Evict down to the shard's share of the budget, always keeping the new tile
+    size_t shardBudget = budget / ShardCount;
+    while (shard.bytes > shardBudget && shard.recent.size() > 1) {
+        auto victim = shard.entries.find(shard.recent.back());
+        size_t victimSize = victim->second.tile->size();
+        shard.bytes -= victimSize;
+        residentBytes -= victimSize;
+        shard.entries.erase(victim);
+        shard.recent.pop_back();
+        STATS_ADD(TextureCacheEvictions, 1);
+    }
+
+    size_t resident = residentBytes.load();
+    size_t peak = peakBytes.load();
+    while (resident > peak && !peakBytes.compare_exchange_weak(peak, resident)) {
+    }
+    return tile;
+}
@@ -0,0 +1,74 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Process-wide cache of texture tiles read on demand from tiled texture files and kept
+// under a memory budget by evicting the least recently used tiles. With a budget of
+// zero (the default) tiling is off and textures stay fully resident.
+//
+// Lookups may come from any render thread. The cache is split into shards, each with
+// its own lock, LRU list and share of the budget; tiles are handed out as shared
+// pointers, so evicting a tile never pulls it from under a thread still reading it.
+class TextureCache {
+public:
+    using Tile = std::shared_ptr<const std::vector<unsigned char>>;
+
+    static TextureCache& global();
+
+    ~TextureCache();
+
+    void setBudget(size_t bytes);
+    bool enabled() const { return budget > 0; }
+
+    // Keeps the file open for tile reads; the returned id names it in getTile
+    int openFile(const std::string& path);
+    // Closes the file and drops its cached tiles; the id is not handed out again
+    void closeFile(int file);
+
+    // Tile `index` of a file, read from `offset` with `size` bytes on a miss. A failed
+    // read is reported on stderr, once per file, and yields an uncached tile of zeros.
+    Tile getTile(int file, uint32_t index, uint64_t offset, size_t size);
+
+    size_t getResidentBytes() const { return residentBytes.load(); }
+    size_t getPeakBytes() const { return peakBytes.load(); }
+    size_t getBudget() const { return budget; }
+
+private:
+    static const int ShardCount = 16;
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<uint64_t> recent; // Most recently used first
+        struct Entry {
+            Tile tile;
+            std::list<uint64_t>::iterator position;
+        };
+        std::unordered_map<uint64_t, Entry> entries;
+        size_t bytes = 0;
+    };
+
+    struct File {
+        int fd;             // -1 once closed
+        std::string path;
+        bool failed = false; // A read failed and was reported
+    };
+
+    size_t budget = 0;
+    Shard shards[ShardCount];
+    std::mutex fileMutex;
+    std::vector<File> files;
+    std::atomic<size_t> residentBytes{0};
+    std::atomic<size_t> peakBytes{0};
+
+    Tile readTile(int file, uint64_t offset, size_t size);
+};
+
+#endif
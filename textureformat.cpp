@@ -0,0 +1,184 @@
+#include "textureformat.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// Round to nearest even; magnitudes past the largest half become infinity
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x47800000) {
+        return sign | (magnitude > 0x7f800000 ? 0x7e00 : 0x7c00);
+    }
+    if (magnitude < 0x38800000) {
+        // Below the smallest normal half: a multiple of 2^-24
+        float absolute;
+        std::memcpy(&absolute, &magnitude, sizeof(absolute));
+        return sign | static_cast<uint16_t>(std::lrint(absolute * 16777216.0f));
+    }
+
+    uint32_t half = (magnitude - 0x38000000) >> 13;
+    uint32_t remainder = magnitude & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+        ++half;
+    }
+    return sign | static_cast<uint16_t>(half);
+}
+
+uint8_t toByte(float value) {
+    return static_cast<uint8_t>(std::lrint(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+uint16_t to565(const Color& color) {
+    auto quantize = [](float value, int levels) {
+        return static_cast<uint16_t>(std::lrint(std::clamp(value, 0.0f, 1.0f) * levels));
+    };
+    return (quantize(color.r, 31) << 11) | (quantize(color.g, 63) << 5) | quantize(color.b, 31);
+}
+
+// Endpoints at the extremes of the texels' principal axis, which a few power
+// iterations of the covariance matrix find; each texel then takes the nearest of the
+// four palette entries. Endpoints are ordered for four-entry mode.
+void encodeBC1Block(const Color texels[16], unsigned char* block) {
+    Color mean;
+    for (int i = 0; i < 16; ++i) mean = mean + texels[i] * (1.0f / 16.0f);
+
+    float covariance[3][3] = {};
+    for (int i = 0; i < 16; ++i) {
+        float d[3] = {texels[i].r - mean.r, texels[i].g - mean.g, texels[i].b - mean.b};
+        for (int a = 0; a < 3; ++a)
+            for (int b = 0; b < 3; ++b) covariance[a][b] += d[a] * d[b];
+    }
+
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[3];
+        for (int a = 0; a < 3; ++a) {
+            next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+        }
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-12f) break; // Flat block: any axis will do
+        for (int a = 0; a < 3; ++a) axis[a] = next[a] / length;
+    }
+
+    float lowest = 0.0f, highest = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float t = (texels[i].r - mean.r) * axis[0] + (texels[i].g - mean.g) * axis[1] + (texels[i].b - mean.b) * axis[2];
+        lowest = std::min(lowest, t);
+        highest = std::max(highest, t);
+    }
+    Color direction(axis[0], axis[1], axis[2]);
+    uint16_t endpoints[2] = {to565(mean + direction * highest), to565(mean + direction * lowest)};
+    if (endpoints[0] < endpoints[1]) {
+        std::swap(endpoints[0], endpoints[1]);
+    }
+
+    uint32_t indices = 0;
+    if (endpoints[0] > endpoints[1]) {
+        Color palette[4];
+        for (int entry = 0; entry < 4; ++entry) {
+            const float* weights = textureformat::BC1Weights[1][entry];
+            palette[entry] = textureformat::unpack565(endpoints[0]) * weights[0] +
+                             textureformat::unpack565(endpoints[1]) * weights[1];
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            float bestDistance = INFINITY;
+            for (int entry = 0; entry < 4; ++entry) {
+                float dr = texels[i].r - palette[entry].r, dg = texels[i].g - palette[entry].g,
+                      db = texels[i].b - palette[entry].b;
+                float distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = entry;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (2 * i);
+        }
+    }
+
+    std::memcpy(block, endpoints, sizeof(endpoints));
+    std::memcpy(block + 4, &indices, sizeof(indices));
+}
+
+} // namespace
+
+TextureFormat parseTextureFormat(const std::string& name) {
+    if (name == "float") return TextureFormat::Float;
+    if (name == "fp16") return TextureFormat::FP16;
+    if (name == "rgba8") return TextureFormat::RGBA8;
+    if (name == "rgb8") return TextureFormat::RGB8;
+    if (name == "bc1") return TextureFormat::BC1;
+    throw std::runtime_error("Unknown texture format: " + name);
+}
+
+const char* textureFormatName(TextureFormat format) {
+    switch (format) {
+    case TextureFormat::Float: return "float";
+    case TextureFormat::FP16: return "fp16";
+    case TextureFormat::RGBA8: return "rgba8";
+    case TextureFormat::RGB8: return "rgb8";
+    case TextureFormat::BC1: return "bc1";
+    }
+    return "unknown";
+}
+
+size_t textureBytes(TextureFormat format, int width, int height) {
+    size_t texels = static_cast<size_t>(width) * height;
+    switch (format) {
+    case TextureFormat::Float: return 12 * texels;
+    case TextureFormat::FP16: return 8 * texels;
+    case TextureFormat::RGBA8: return 4 * texels;
+    case TextureFormat::RGB8: return 3 * texels;
+    case TextureFormat::BC1: return 8 * static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+    }
+    return 0;
+}
+
+void encodeTexture(TextureFormat format, const float* rgb, int width, int height, unsigned char* out) {
+    size_t texels = static_cast<size_t>(width) * height;
+    switch (format) {
+    case TextureFormat::Float:
+        std::memcpy(out, rgb, 12 * texels);
+        return;
+    case TextureFormat::FP16:
+        for (size_t i = 0; i < texels; ++i) {
+            uint16_t halves[4] = {floatToHalf(rgb[3 * i]), floatToHalf(rgb[3 * i + 1]), floatToHalf(rgb[3 * i + 2]), 0};
+            std::memcpy(out + 8 * i, halves, sizeof(halves));
+        }
+        return;
+    case TextureFormat::RGBA8:
+        for (size_t i = 0; i < texels; ++i) {
+            unsigned char* texel = out + 4 * i;
+            texel[0] = toByte(rgb[3 * i]);
+            texel[1] = toByte(rgb[3 * i + 1]);
+            texel[2] = toByte(rgb[3 * i + 2]);
+            texel[3] = 255;
+        }
+        return;
+    case TextureFormat::RGB8:
+        for (size_t i = 0; i < 3 * texels; ++i) {
+            out[i] = toByte(rgb[i]);
+        }
+        return;
+    case TextureFormat::BC1:
+        // Blocks past the right or bottom edge repeat the last column or row
+        for (int blockY = 0; blockY < (height + 3) / 4; ++blockY) {
+            for (int blockX = 0; blockX < (width + 3) / 4; ++blockX) {
+                Color texels[16];
+                for (int i = 0; i < 16; ++i) {
+                    int x = std::min(4 * blockX + i % 4, width - 1), y = std::min(4 * blockY + i / 4, height - 1);
+                    const float* texel = rgb + 3 * (static_cast<size_t>(y) * width + x);
+                    texels[i] = Color(texel[0], texel[1], texel[2]);
+                }
+                encodeBC1Block(texels, out + 8 * (static_cast<size_t>(blockY) * ((width + 3) / 4) + blockX));
+            }
+        }
+        return;
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef TEXTUREFORMAT_H
+#define TEXTUREFORMAT_H
+
+#include "color.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef VECTOR3_SSE
+#include <emmintrin.h>
+#endif
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+// Texel storage formats, from largest to smallest:
+//   Float  12 bytes  three floats, exact
+//   FP16    8 bytes  three half floats and a padding half
+//   RGBA8   4 bytes  8-bit channels with an opaque alpha, one aligned word per texel
+//   RGB8    3 bytes  8-bit channels, exact for 8-bit sources at full resolution
+//   BC1   0.5 bytes  4x4 blocks of two RGB565 endpoints and 2-bit interpolation indices
+enum class TextureFormat { Float, FP16, RGBA8, RGB8, BC1 };
+
+// Throws std::runtime_error for unknown names
+TextureFormat parseTextureFormat(const std::string& name);
+const char* textureFormatName(TextureFormat format);
+
+// Bytes of an image of the given size; BC1 rounds it up to whole blocks
+size_t textureBytes(TextureFormat format, int width, int height);
+
+// Encodes packed RGB floats (three per texel, row by row) into `out`, which holds
+// textureBytes(format, width, height) bytes
+void encodeTexture(TextureFormat format, const float* rgb, int width, int height, unsigned char* out);
+
+namespace textureformat {
+
+#ifdef VECTOR3_SSE
+// Four 8-bit channels in the low bytes of `packed` to floats in [0, 1], the fourth
+// lane cleared. Divides rather than multiplying by 1/255 to round like the float path.
+inline Color unpack8(uint32_t packed) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i channels = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(packed)), zero), zero);
+    __m128 rgb = _mm_div_ps(_mm_cvtepi32_ps(channels), _mm_set1_ps(255.0f));
+    return Color(_mm_and_ps(rgb, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1))));
+}
+#else
+inline Color unpack8(uint32_t packed) {
+    return Color((packed & 0xff) / 255.0f, ((packed >> 8) & 0xff) / 255.0f, ((packed >> 16) & 0xff) / 255.0f);
+}
+#endif
+
+// Four half floats to a color; the padding half is zero
+inline Color unpackHalf(const unsigned char* halves) {
+#if defined(__F16C__)
+    return Color(_mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(halves))));
+#elif defined(VECTOR3_SSE)
+    // Shift exponent and mantissa into float position and rescale the exponent bias
+    // by 2^112, which also normalizes denormals; infinities and NaNs get the float's
+    // all-ones exponent back
+    __m128i h = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(halves)), _mm_setzero_si128());
+    __m128i magnitude = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+    __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+    __m128 value = _mm_mul_ps(_mm_castsi128_ps(magnitude), _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+    __m128i special = _mm_and_si128(_mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x0f7fffff)), _mm_set1_epi32(0x7f800000));
+    return Color(_mm_or_ps(_mm_or_ps(value, _mm_castsi128_ps(special)), _mm_castsi128_ps(sign)));
+#else
+    auto toFloat = [](uint16_t half) {
+        uint32_t magnitude = static_cast<uint32_t>(half & 0x7fff) << 13;
+        float value;
+        std::memcpy(&value, &magnitude, sizeof(value));
+        value *= 5.192296858534828e33f; // 2^112
+        if ((half & 0x7c00) == 0x7c00) value = half & 0x3ff ? NAN : INFINITY;
+        return half & 0x8000 ? -value : value;
+    };
+    uint16_t h[3];
+    std::memcpy(h, halves, sizeof(h));
+    return Color(toFloat(h[0]), toFloat(h[1]), toFloat(h[2]));
+#endif
+}
+
+inline Color unpack565(uint16_t packed) {
+#ifdef VECTOR3_SSE
+    __m128i channels = _mm_set_epi32(0, packed & 31, (packed >> 5) & 63, packed >> 11);
+    return Color(_mm_mul_ps(_mm_cvtepi32_ps(channels), _mm_set_ps(0.0f, 1.0f / 31.0f, 1.0f / 63.0f, 1.0f / 31.0f)));
+#else
+    return Color((packed >> 11) / 31.0f, ((packed >> 5) & 63) / 63.0f, (packed & 31) / 31.0f);
+#endif
+}
+
+// Endpoint weights of the four palette entries of a BC1 block: interpolated thirds when
+// the first endpoint is larger, otherwise the midpoint and black
+const float BC1Weights[2][4][2] = {
+    {{1.0f, 0.0f}, {0.0f, 1.0f}, {0.5f, 0.5f}, {0.0f, 0.0f}},
+    {{1.0f, 0.0f}, {0.0f, 1.0f}, {2.0f / 3.0f, 1.0f / 3.0f}, {1.0f / 3.0f, 2.0f / 3.0f}},
+};
+
+} // namespace textureformat
+
+// Texel (x, y) of an image `width` texels wide
+inline Color decodeTexel(TextureFormat format, const unsigned char* image, int width, int x, int y) {
+    using namespace textureformat;
+    size_t texel = static_cast<size_t>(y) * width + x;
+    switch (format) {
+    case TextureFormat::Float: {
+        float rgb[3];
+        std::memcpy(rgb, image + 12 * texel, sizeof(rgb));
+        return Color(rgb[0], rgb[1], rgb[2]);
+    }
+    case TextureFormat::FP16:
+        return unpackHalf(image + 8 * texel);
+    case TextureFormat::RGBA8: {
+        uint32_t packed;
+        std::memcpy(&packed, image + 4 * texel, sizeof(packed));
+        return unpack8(packed);
+    }
+    case TextureFormat::RGB8: {
+        const unsigned char* rgb = image + 3 * texel;
+        return unpack8(rgb[0] | (rgb[1] << 8) | (rgb[2] << 16));
+    }
+    case TextureFormat::BC1: {
+        const unsigned char* block = image + 8 * (static_cast<size_t>(y / 4) * ((width + 3) / 4) + x / 4);
+        uint16_t endpoints[2];
+        uint32_t indices;
+        std::memcpy(endpoints, block, sizeof(endpoints));
+        std::memcpy(&indices, block + 4, sizeof(indices));
+        const float* weights = BC1Weights[endpoints[0] > endpoints[1]][(indices >> (2 * (4 * (y & 3) + (x & 3)))) & 3];
+        return unpack565(endpoints[0]) * weights[0] + unpack565(endpoints[1]) * weights[1];
+    }
+    }
+    return Color();
+}
+
+#endif
@@ -3,33 +3,23 @@
 
 #include "vector3.h"
 #include "ray.h"
-#include "color.h"
-#include "texture.h"
+#include "material.h"
 #include "boundingbox.h"
 
 class Triangle {
 public:
-    Triangle(const Vector3 &v0, const Vector3 &v1, const Vector3 &v2,
-             const Color &color, float reflectivity = 0.0f,
-             float transparency = 0.0f, float refractiveIndex = 1.0f,
-             Texture* texture = nullptr);
+    Triangle(const Vector3 &v0, const Vector3 &v1, const Vector3 &v2, MaterialId materialId = 0);
 
     bool doesIntersect(const Ray &ray) const;
     float getIntersectionDistance(const Ray &ray) const;
     Vector3 getNormal(const Vector3 &point) const;
-    Color getColor(const Vector3& hitPoint) const;
-    float getReflectivity() const;
-    float getTransparency() const;
-    float getRefractiveIndex() const;
+    void getTextureCoordinates(const Vector3 &hitPoint, float &u, float &v) const;
+    MaterialId getMaterialId() const;
     BoundingBox getBoundingBox() const;
 
 private:
     Vector3 v0, v1, v2;
-    Color color;
-    float reflectivity;
-    float transparency;
-    float refractiveIndex;
-    Texture* texture;
+    MaterialId materialId;
 };
 
 #endif
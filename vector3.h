@@ -3,21 +3,46 @@
 
 #include <cmath>
 
-class Vector3 {
+// SSE is part of the x86-64 baseline; other targets use the scalar fallbacks
+#if defined(__SSE2__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define VECTOR3_SSE 1
+#endif
+
+// Float4-backed vector: x, y, z plus a padding lane kept at zero so the whole
+// vector loads into one 16-byte register.
+class alignas(16) Vector3 {
 public:
-    float x, y, z;
+    float x, y, z, w;
 
-    Vector3() : x(0), y(0), z(0) {}
-    Vector3(float x, float y, float z) : x(x), y(y), z(z) {}
+    Vector3() : x(0), y(0), z(0), w(0) {}
+    Vector3(float x, float y, float z) : x(x), y(y), z(z), w(0) {}
+
+#ifdef VECTOR3_SSE
+    explicit Vector3(__m128 v) { _mm_store_ps(&x, v); }
+    __m128 simd() const { return _mm_load_ps(&x); }
+#endif
+
+    float operator[](int axis) const {
+        return (&x)[axis];
+    }
 
     // Vector addition
     Vector3 operator+(const Vector3 &other) const {
+#ifdef VECTOR3_SSE
+        return Vector3(_mm_add_ps(simd(), other.simd()));
+#else
         return Vector3(x + other.x, y + other.y, z + other.z);
+#endif
     }
 
     // Vector subtraction
     Vector3 operator-(const Vector3 &other) const {
+#ifdef VECTOR3_SSE
+        return Vector3(_mm_sub_ps(simd(), other.simd()));
+#else
         return Vector3(x - other.x, y - other.y, z - other.z);
+#endif
     }
 
     // Unary negation
@@ -25,6 +50,14 @@ public:
         return Vector3(-x, -y, -z);
     }
 
+    Vector3& operator+=(const Vector3 &other) {
+        return *this = *this + other;
+    }
+
+    Vector3& operator-=(const Vector3 &other) {
+        return *this = *this - other;
+    }
+
     // Dot product
     float dot(const Vector3 &other) const {
         return x * other.x + y * other.y + z * other.z;
@@ -41,27 +74,71 @@ public:
 
     // Scalar multiplication
     Vector3 operator*(float scalar) const {
+#ifdef VECTOR3_SSE
+        return Vector3(_mm_mul_ps(simd(), _mm_set1_ps(scalar)));
+#else
         return Vector3(x * scalar, y * scalar, z * scalar);
+#endif
+    }
+
+    // Component-wise multiplication
+    Vector3 operator*(const Vector3 &other) const {
+#ifdef VECTOR3_SSE
+        return Vector3(_mm_mul_ps(simd(), other.simd()));
+#else
+        return Vector3(x * other.x, y * other.y, z * other.z);
+#endif
     }
 
     // Scalar division
     Vector3 operator/(float scalar) const {
-        return Vector3(x / scalar, y / scalar, z / scalar);
+        return (*this) * (1.0f / scalar);
     }
 
-    // Normalize vector
+    // Normalize vector. Uses the correctly rounded square root and divide: the rsqrt
+    // estimate differs between CPU models even after a Newton-Raphson step, which would
+    // let farm workers on different machines disagree in the low bits.
     Vector3 normalize() const {
-        float magnitude = std::sqrt(x * x + y * y + z * z);
-        return (*this) / magnitude;
+        return (*this) * (1.0f / std::sqrt(dot(*this)));
     }
 
     float length() const {
         return std::sqrt(x * x + y * y + z * z);
     }
+
+    float lengthSquared() const {
+        return dot(*this);
+    }
+
+    // Fused multiply-add: a * scalar + b, e.g. points along a ray
+    static Vector3 madd(const Vector3 &a, float scalar, const Vector3 &b) {
+#ifdef VECTOR3_SSE
+        return Vector3(_mm_add_ps(_mm_mul_ps(a.simd(), _mm_set1_ps(scalar)), b.simd()));
+#else
+        return Vector3(a.x * scalar + b.x, a.y * scalar + b.y, a.z * scalar + b.z);
+#endif
+    }
+
+    // Component-wise minimum and maximum
+    static Vector3 min(const Vector3 &a, const Vector3 &b) {
+#ifdef VECTOR3_SSE
+        return Vector3(_mm_min_ps(a.simd(), b.simd()));
+#else
+        return Vector3(std::fmin(a.x, b.x), std::fmin(a.y, b.y), std::fmin(a.z, b.z));
+#endif
+    }
+
+    static Vector3 max(const Vector3 &a, const Vector3 &b) {
+#ifdef VECTOR3_SSE
+        return Vector3(_mm_max_ps(a.simd(), b.simd()));
+#else
+        return Vector3(std::fmax(a.x, b.x), std::fmax(a.y, b.y), std::fmax(a.z, b.z));
+#endif
+    }
 };
 
 inline Vector3 operator*(float scalar, const Vector3 &vector) {
-    return Vector3(vector.x * scalar, vector.y * scalar, vector.z * scalar);
+    return vector * scalar;
 }
 
 #endif
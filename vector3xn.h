@@ -0,0 +1,107 @@
+#ifndef VECTOR3XN_H
+#define VECTOR3XN_H
+
+#include "vector3.h"
+#include <cmath>
+
+// N floats processed in lock step. The fixed-size loops below are written so the
+// compiler vectorizes them to whatever SIMD width the target offers.
+template <int N>
+struct alignas(N * sizeof(float)) FloatN {
+    float v[N];
+
+    static FloatN broadcast(float value) {
+        FloatN result;
+        for (int i = 0; i < N; ++i) result.v[i] = value;
+        return result;
+    }
+
+    float operator[](int lane) const { return v[lane]; }
+    float& operator[](int lane) { return v[lane]; }
+
+    FloatN operator+(const FloatN &other) const {
+        FloatN result;
+        for (int i = 0; i < N; ++i) result.v[i] = v[i] + other.v[i];
+        return result;
+    }
+
+    FloatN operator-(const FloatN &other) const {
+        FloatN result;
+        for (int i = 0; i < N; ++i) result.v[i] = v[i] - other.v[i];
+        return result;
+    }
+
+    FloatN operator*(const FloatN &other) const {
+        FloatN result;
+        for (int i = 0; i < N; ++i) result.v[i] = v[i] * other.v[i];
+        return result;
+    }
+
+    FloatN operator/(const FloatN &other) const {
+        FloatN result;
+        for (int i = 0; i < N; ++i) result.v[i] = v[i] / other.v[i];
+        return result;
+    }
+};
+
+// Structure-of-arrays bundle of N vectors for packet and stream code: lane i of
+// x, y and z together form vector i.
+template <int N>
+struct Vector3xN {
+    FloatN<N> x, y, z;
+
+    static Vector3xN broadcast(const Vector3 &vector) {
+        return {FloatN<N>::broadcast(vector.x), FloatN<N>::broadcast(vector.y), FloatN<N>::broadcast(vector.z)};
+    }
+
+    Vector3 get(int lane) const {
+        return Vector3(x[lane], y[lane], z[lane]);
+    }
+
+    void set(int lane, const Vector3 &vector) {
+        x[lane] = vector.x;
+        y[lane] = vector.y;
+        z[lane] = vector.z;
+    }
+
+    Vector3xN operator+(const Vector3xN &other) const {
+        return {x + other.x, y + other.y, z + other.z};
+    }
+
+    Vector3xN operator-(const Vector3xN &other) const {
+        return {x - other.x, y - other.y, z - other.z};
+    }
+
+    Vector3xN operator*(const FloatN<N> &scalars) const {
+        return {x * scalars, y * scalars, z * scalars};
+    }
+
+    FloatN<N> dot(const Vector3xN &other) const {
+        return x * other.x + y * other.y + z * other.z;
+    }
+
+    Vector3xN cross(const Vector3xN &other) const {
+        return {y * other.z - z * other.y,
+                z * other.x - x * other.z,
+                x * other.y - y * other.x};
+    }
+
+    Vector3xN normalize() const {
+        FloatN<N> lengthSquared = dot(*this);
+        FloatN<N> inverseLength;
+        for (int i = 0; i < N; ++i) inverseLength[i] = 1.0f / std::sqrt(lengthSquared[i]);
+        return (*this) * inverseLength;
+    }
+
+    // Fused multiply-add: a * scalars + b
+    static Vector3xN madd(const Vector3xN &a, const FloatN<N> &scalars, const Vector3xN &b) {
+        return {a.x * scalars + b.x, a.y * scalars + b.y, a.z * scalars + b.z};
+    }
+};
+
+using Float4 = FloatN<4>;
+using Float8 = FloatN<8>;
+using Vector3x4 = Vector3xN<4>;
+using Vector3x8 = Vector3xN<8>;
+
+#endif